@@ -0,0 +1,137 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+struct CameraKeyframe
+{
+    f32 time;
+    p3 position;
+    p3 lookAt;
+};
+
+// NOTE(mevex): Same transform as Instance, rotations are interpolated in degrees so a key can
+//              turn more than half a circle
+struct InstanceKeyframe
+{
+    f32 time;
+    f32 scale;
+    f32 rotations[3];
+    p3 position;
+};
+
+struct InstanceTrack
+{
+    u32 instance;
+    vector<InstanceKeyframe> keys;
+};
+
+// NOTE(mevex): Finds the keys around time and how far between them it is. Before the first key
+//              and after the last one the animation holds still. keys must be sorted by time.
+template<typename T>
+void FindKeyframes(vector<T> &keys, f32 time, T *&a, T *&b, f32 &t)
+{
+    Assert(!keys.empty());
+    
+    size_t next = 0;
+    while(next < keys.size() && keys[next].time <= time)
+        ++next;
+    
+    a = &keys[next > 0 ? next - 1 : 0];
+    b = &keys[next < keys.size() ? next : keys.size() - 1];
+    
+    f32 span = b->time - a->time;
+    t = span > 0.0f ? Clamp((time - a->time) / span, 0.0f, 1.0f) : 0.0f;
+}
+
+// NOTE(mevex): Keyframes of the camera and of the instances, linearly interpolated.
+//              Instances without a track are left where they are.
+class Animation
+{
+    public:
+    
+    v3 viewUp = v3(0,1,0);
+    f32 verticalFOV = 60.0f;
+    
+    vector<CameraKeyframe> cameraKeys;
+    vector<InstanceTrack> tracks;
+    
+    // NOTE(mevex): Keys must be added in time order
+    void AddCameraKey(f32 time, p3 position, p3 lookAt)
+    {
+        Assert(cameraKeys.empty() || cameraKeys.back().time <= time);
+        cameraKeys.push_back({time, position, lookAt});
+    }
+    
+    void AddInstanceKey(u32 instance, f32 time, Instance &pose)
+    {
+        InstanceTrack *track = NULL;
+        for(InstanceTrack &t : tracks)
+        {
+            if(t.instance == instance)
+                track = &t;
+        }
+        if(!track)
+        {
+            tracks.push_back({instance, {}});
+            track = &tracks.back();
+        }
+        
+        Assert(track->keys.empty() || track->keys.back().time <= time);
+        InstanceKeyframe key;
+        key.time = time;
+        key.scale = pose.scale;
+        key.rotations[X] = pose.rotations[X];
+        key.rotations[Y] = pose.rotations[Y];
+        key.rotations[Z] = pose.rotations[Z];
+        key.position = pose.position;
+        track->keys.push_back(key);
+    }
+    
+    f32 Duration()
+    {
+        f32 result = cameraKeys.empty() ? 0.0f : cameraKeys.back().time;
+        for(InstanceTrack &track : tracks)
+        {
+            if(!track.keys.empty())
+                result = Max(result, track.keys.back().time);
+        }
+        return result;
+    }
+    
+    // NOTE(mevex): Moves the animated instances to where they are at time
+    void PoseInstances(f32 time, vector<Instance> &instances)
+    {
+        for(InstanceTrack &track : tracks)
+        {
+            if(track.keys.empty() || track.instance >= instances.size())
+                continue;
+            
+            InstanceKeyframe *a, *b;
+            f32 t;
+            FindKeyframes(track.keys, time, a, b, t);
+            
+            Instance &instance = instances[track.instance];
+            instance.scale = Lerp(a->scale, b->scale, t);
+            for(int axis = X; axis <= Z; ++axis)
+                instance.rotations[axis] = Lerp(a->rotations[axis], b->rotations[axis], t);
+            instance.position = Lerp(a->position, b->position, t);
+        }
+    }
+    
+    // NOTE(mevex): The camera is built for the given canvas, all the canvases of an animation
+    //              must have the same size
+    Camera CameraAt(f32 time, Canvas &canvas)
+    {
+        Assert(!cameraKeys.empty());
+        
+        CameraKeyframe *a, *b;
+        f32 t;
+        FindKeyframes(cameraKeys, time, a, b, t);
+        
+        p3 position = Lerp(a->position, b->position, t);
+        p3 lookAt = Lerp(a->lookAt, b->lookAt, t);
+        Camera result(position, lookAt, viewUp, verticalFOV, canvas);
+        return result;
+    }
+};
+
+#endif //ANIMATION_H
@@ -0,0 +1,150 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+// NOTE(mevex): Array over memory that someone else owns (usually an arena), it never grows
+template <typename T>
+struct FixedArray
+{
+    T *e;
+    size_t count;
+    size_t capacity;
+    
+    inline T &operator[](size_t i)
+    {
+        Assert(i < count);
+        return e[i];
+    }
+    
+    inline void Add(T value)
+    {
+        Assert(count < capacity);
+        e[count++] = value;
+    }
+    
+    inline T *begin() { return e; }
+    inline T *end() { return e + count; }
+};
+
+template <typename T>
+inline FixedArray<T> ToFixedArray(vector<T> &v)
+{
+    FixedArray<T> result = {v.data(), v.size(), v.size()};
+    return result;
+}
+
+struct ArenaOverflowBlock
+{
+    ArenaOverflowBlock *next;
+    size_t pad; // NOTE(mevex): keeps the memory after the header 16 bytes aligned
+};
+
+// NOTE(mevex): Linear allocator for everything that lives for a single frame.
+//              Pushing is a pointer bump and Reset throws everything away at once.
+//              If a frame does not fit, the extra memory comes from the heap and on the
+//              next Reset the arena grows to the peak, so the steady state never hits the heap.
+class MemoryArena
+{
+    public:
+    
+    u8 *base;
+    size_t size;
+    size_t used;
+    ArenaOverflowBlock *overflow;
+    size_t overflowUsed;
+    
+    // NOTE(mevex): Stats for the last frame, valid until the next Reset
+    u32 pushesCount;
+    size_t peakUsed;
+    
+    // NOTE(mevex): Number of times the arena asked the heap for memory since it was created
+    u32 heapAllocationsCount;
+    
+    MemoryArena(size_t initialSize = 16*1024*1024)
+    {
+        size = initialSize;
+        base = (u8 *)malloc(size);
+        used = 0;
+        overflow = NULL;
+        overflowUsed = 0;
+        pushesCount = 0;
+        peakUsed = 0;
+        heapAllocationsCount = 1;
+    }
+    
+    ~MemoryArena()
+    {
+        Reset();
+        free(base);
+    }
+    
+    void *PushSize(size_t bytes)
+    {
+        bytes = (bytes + 15) & ~(size_t)15;
+        ++pushesCount;
+        
+        void *result;
+        if(used + bytes <= size)
+        {
+            result = base + used;
+            used += bytes;
+        }
+        else
+        {
+            ArenaOverflowBlock *block = (ArenaOverflowBlock *)malloc(sizeof(ArenaOverflowBlock) + bytes);
+            block->next = overflow;
+            overflow = block;
+            overflowUsed += bytes;
+            ++heapAllocationsCount;
+            result = block + 1;
+        }
+        
+        size_t total = used + overflowUsed;
+        if(peakUsed < total)
+            peakUsed = total;
+        
+        return result;
+    }
+    
+    template <typename T>
+    inline T *PushArray(size_t count)
+    {
+        return (T *)PushSize(count * sizeof(T));
+    }
+    
+    template <typename T>
+    inline FixedArray<T> PushFixedArray(size_t capacity)
+    {
+        FixedArray<T> result = {PushArray<T>(capacity), 0, capacity};
+        return result;
+    }
+    
+    void Reset()
+    {
+        if(overflow)
+        {
+            while(overflow)
+            {
+                ArenaOverflowBlock *next = overflow->next;
+                free(overflow);
+                overflow = next;
+            }
+            
+            // NOTE(mevex): Grow so that a frame like the last one fits in a single block
+            size_t newSize = size;
+            while(newSize < peakUsed)
+                newSize *= 2;
+            
+            free(base);
+            base = (u8 *)malloc(newSize);
+            size = newSize;
+            ++heapAllocationsCount;
+        }
+        
+        used = 0;
+        overflowUsed = 0;
+        pushesCount = 0;
+        peakUsed = 0;
+    }
+};
+
+#endif //ARENA_H
@@ -0,0 +1,493 @@
+#include "main.h"
+#include "render.cpp"
+
+#include <algorithm>
+#include <memory>
+#include <string.h>
+
+// NOTE(mevex): Headless benchmark. It builds reproducible scenes, renders a few warm up frames
+//              and then times N frames stage by stage. The results are written as JSON so that
+//              two versions of the renderer can be compared. Nothing is shown or saved as an image.
+//
+//              benchmark [-scene fox|sphere|grid|mixed|city] [-instances N | -sweep MAX] [-frames N]
+//                        [-warmup N] [-seed N] [-threads N] [-rasterizer tiles|tiles-fixed|edge|fixed|scanline]
+//                        [-width W] [-height H] [-layout linear|tiled] [-depth unorm16|unorm24|float32]
+//                        [-stats 0|1] [-hdr 0|1] [-occlusion 0|1] [-sort 0|1] [-visibility 0|1]
+//                        [-encode png|stbpng|qoi] [-level N] [-out file.json]
+//
+//              -sweep runs 10, 100, 1000... instances up to MAX, -instances a single scene.
+//              -stats 1 adds the pipeline counters of the last frame, it slows the frames down a bit.
+//              pixels_per_sec counts the pixels that passed the depth test.
+//              -hdr 1 draws into the float color buffer and resolves it at the end of the frame.
+//              -occlusion 1 culls the instances hidden behind the big ones with the depth pyramid.
+//              -sort 1 draws the instances front to back, the sort is timed as its own stage.
+//              -visibility 1 rasterizes triangle ids and shades each visible pixel once at the end.
+//              city lays the mixed meshes on a grid in front of the camera, most of them hidden.
+//              -encode also times encoding every frame in memory, at -level for PNG. It is not
+//              part of the frame time.
+
+enum benchmark_scene
+{
+    SCENE_FOX,
+    SCENE_SPHERE,
+    SCENE_GRID,
+    SCENE_MIXED,
+    SCENE_CITY,
+    
+    SCENES_COUNT
+};
+
+global_variable const char *sceneNames[SCENES_COUNT] = {"fox", "sphere", "grid", "mixed", "city"};
+
+// NOTE(mevex): rand() is not the same on every platform, the scenes must be the same everywhere
+struct BenchmarkRandom
+{
+    u32 state;
+    
+    inline u32 Next()
+    {
+        // NOTE(mevex): xorshift32
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+    
+    inline f32 Float(f32 min, f32 max)
+    {
+        f32 t = (f32)(Next() >> 8) * (1.0f / 16777216.0f);
+        return min + (max - min)*t;
+    }
+};
+
+// NOTE(mevex): A wavy square patch of cells x cells quads, centered on the origin with side 2
+void MakeGridMesh(Mesh *mesh, int cells)
+{
+    f32 step = 2.0f / cells;
+    for(int j = 0; j <= cells; ++j)
+    {
+        for(int i = 0; i <= cells; ++i)
+        {
+            f32 x = -1.0f + i*step;
+            f32 z = -1.0f + j*step;
+            f32 y = 0.15f * sinf(3.0f*x) * cosf(3.0f*z);
+            mesh->Add(p3(x, y, z));
+        }
+    }
+    
+    Color color = Color(0.3f, 0.7f, 0.3f);
+    int row = cells + 1;
+    for(int j = 0; j < cells; ++j)
+    {
+        for(int i = 0; i < cells; ++i)
+        {
+            int a = j*row + i;
+            Triangle t0 = {a, a + row, a + 1, color};
+            Triangle t1 = {a + 1, a + row, a + row + 1, color};
+            mesh->Add(t0);
+            mesh->Add(t1);
+        }
+    }
+    
+    mesh->CalculateBoundingSphere();
+    mesh->CalculateFaceNormals();
+    mesh->OrderTrianglesForOverdraw();
+}
+
+// NOTE(mevex): The instances fill a cube around the camera that grows with their number,
+//              so the density, and the fraction of them inside the frustum, stays about the same.
+//              The city instead is a square of blocks at the height of the camera, starting in
+//              front of it, so the first rows hide most of the others.
+void BuildScene(vector<Instance> &scene, int sceneType, int count, u32 seed, Mesh **meshes)
+{
+    BenchmarkRandom random = {seed ? seed : 1};
+    f32 halfSide = 3.0f*cbrtf((f32)count) + 5.0f;
+    i32 citySide = (i32)ceil(sqrt((f64)count));
+    f32 cityStep = 2.5f;
+    
+    scene.clear();
+    scene.reserve(count);
+    for(int i = 0; i < count; ++i)
+    {
+        Instance inst;
+        int type = sceneType;
+        if(type == SCENE_MIXED || type == SCENE_CITY)
+            type = (int)(random.Next() % SCENE_MIXED);
+        inst.mesh = meshes[type];
+        
+        inst.scale = random.Float(0.5f, 1.5f);
+        inst.rotations[X] = random.Float(-90.0f, 90.0f);
+        inst.rotations[Y] = random.Float(-180.0f, 180.0f);
+        inst.rotations[Z] = random.Float(-90.0f, 90.0f);
+        inst.position = p3(random.Float(-halfSide, halfSide), random.Float(-halfSide, halfSide), random.Float(-halfSide, halfSide));
+        if(sceneType == SCENE_CITY)
+        {
+            inst.scale = random.Float(1.0f, 2.0f);
+            inst.position = p3(((i % citySide) - 0.5f*(citySide - 1))*cityStep, random.Float(-0.5f, 0.5f), -5.0f - (i / citySide)*cityStep);
+        }
+        scene.push_back(inst);
+    }
+}
+
+struct TimingSummary
+{
+    f64 min;
+    f64 median;
+    f64 p99;
+};
+
+// NOTE(mevex): Nearest rank percentiles, samples is sorted
+TimingSummary Summarize(vector<f64> &samples)
+{
+    TimingSummary result = {};
+    if(samples.empty())
+        return result;
+    
+    std::sort(samples.begin(), samples.end());
+    size_t count = samples.size();
+    size_t p99Rank = (size_t)ceil(0.99 * count);
+    result.min = samples[0];
+    result.median = samples[(count - 1) / 2];
+    result.p99 = samples[p99Rank - 1];
+    return result;
+}
+
+void WriteTiming(FILE *out, const char *name, TimingSummary &t, bool last)
+{
+    fprintf(out, "        \"%s\": {\"min_ms\": %.4f, \"median_ms\": %.4f, \"p99_ms\": %.4f}%s\n",
+            name, 1000.0*t.min, 1000.0*t.median, 1000.0*t.p99, last ? "" : ",");
+}
+
+struct BenchmarkOptions
+{
+    int scene = SCENE_MIXED;
+    int instances = 1000;
+    int sweep = 0;
+    int frames = 20;
+    int warmup = 3;
+    u32 seed = 1234;
+    int threads = (int)std::thread::hardware_concurrency();
+    bool tiles = true;
+    int rasterizer = RASTERIZER_EDGE_FUNCTION;
+    i32 width = 1280;
+    i32 height = 720;
+    int layout = CANVAS_LAYOUT_LINEAR;
+    int depthFormat = DEPTH_FORMAT_FLOAT32;
+    bool stats = false;
+    bool hdr = false;
+    bool occlusion = false;
+    bool sort = false;
+    bool visibility = false;
+    int encode = -1; // NOTE(mevex): -1 means no encoding
+    int level = 6;
+    const char *out = "benchmark.json";
+};
+
+void RunBenchmark(FILE *out, BenchmarkOptions &options, int instancesCount, Mesh **meshes, bool last)
+{
+    Canvas canvas(options.width, options.height, 4, options.layout, options.depthFormat);
+    if(options.hdr)
+        canvas.EnableHdr();
+    Camera cam(p3(0,0,0), p3(0,0,-1), v3(0,1,0), 60.0f, canvas);
+    
+    LightSet lights;
+    lights.AddPoint(p3(10,20,50), 0.8f);
+    lights.AddAmbient(0.20f);
+    
+    vector<Instance> scene;
+    BuildScene(scene, options.scene, instancesCount, options.seed, meshes);
+    
+    InstanceBVH bvh;
+    bvh.Build(scene);
+    
+    RenderSettings settings;
+    settings.bvh = &bvh;
+    settings.timeStages = true;
+    DepthPyramid occlusion;
+    if(options.occlusion)
+        settings.occlusion = &occlusion;
+    settings.sortInstances = options.sort;
+    std::unique_ptr<VisibilityBuffer> visibility;
+    if(options.visibility)
+    {
+        visibility.reset(new VisibilityBuffer(canvas));
+        settings.visibility = visibility.get();
+    }
+    std::unique_ptr<TileRenderer> tiles;
+    settings.rasterizer = options.rasterizer;
+    if(options.tiles)
+    {
+        tiles.reset(new TileRenderer(canvas, 64, options.threads));
+        settings.tiles = tiles.get();
+    }
+    
+#if RENDER_STATS
+    PipelineStats pipelineStats(tiles ? tiles->pool.workersCount : 1, canvas);
+    if(options.stats)
+        settings.stats = &pipelineStats;
+#endif
+    
+    MemoryArena frameArena;
+    
+    ImageEncoder encoder(tiles ? &tiles->pool : NULL);
+    ImageSettings imageSettings;
+    imageSettings.format = options.encode;
+    imageSettings.compressionLevel = options.level;
+    
+    vector<f64> stageSamples[RENDER_STAGES_COUNT];
+    vector<f64> frameSamples;
+    vector<f64> encodeSamples;
+    RenderStats lastStats = {};
+    u64 trianglesTotal = 0;
+    u64 pixelsTotal = 0;
+    f64 secondsTotal = 0;
+    
+    for(int frame = 0; frame < options.warmup + options.frames; ++frame)
+    {
+        auto start = std::chrono::steady_clock::now();
+        RenderStats stats = Render(scene, lights, canvas, cam, settings, frameArena);
+        f64 seconds = std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+        
+        f64 encodeSeconds = 0;
+        if(options.encode >= 0)
+        {
+            auto encodeStart = std::chrono::steady_clock::now();
+            encoder.Encode(canvas, imageSettings);
+            encodeSeconds = std::chrono::duration<f64>(std::chrono::steady_clock::now() - encodeStart).count();
+        }
+        
+        if(frame < options.warmup)
+            continue;
+        
+        if(options.encode >= 0)
+            encodeSamples.push_back(encodeSeconds);
+        for(int stage = 0; stage < RENDER_STAGES_COUNT; ++stage)
+            stageSamples[stage].push_back(stats.stageSeconds[stage]);
+        frameSamples.push_back(seconds);
+        trianglesTotal += stats.rasterizedTrianglesCount;
+        pixelsTotal += stats.pixelsWrittenCount;
+        secondsTotal += seconds;
+        lastStats = stats;
+    }
+    
+    const char *rasterizerName = rasterizerNames[options.rasterizer];
+    if(options.tiles)
+        rasterizerName = (options.rasterizer == RASTERIZER_FIXED_POINT) ? "tiles-fixed" : "tiles";
+    
+    f64 trianglesPerSecond = secondsTotal > 0 ? (f64)trianglesTotal / secondsTotal : 0;
+    f64 pixelsPerSecond = secondsTotal > 0 ? (f64)pixelsTotal / secondsTotal : 0;
+    
+    fprintf(out, "    {\n");
+    fprintf(out, "      \"scene\": \"%s\",\n", sceneNames[options.scene]);
+    fprintf(out, "      \"instances\": %d,\n", instancesCount);
+    fprintf(out, "      \"seed\": %u,\n", options.seed);
+    fprintf(out, "      \"width\": %d,\n", canvas.width);
+    fprintf(out, "      \"height\": %d,\n", canvas.height);
+    fprintf(out, "      \"layout\": \"%s\",\n", canvas.layout.type == CANVAS_LAYOUT_TILED ? "tiled" : "linear");
+    fprintf(out, "      \"depth\": \"%s\",\n", depthFormatNames[canvas.depthFormat]);
+    fprintf(out, "      \"rasterizer\": \"%s\",\n", rasterizerName);
+    fprintf(out, "      \"threads\": %d,\n", tiles ? options.threads : 1);
+    fprintf(out, "      \"lane_width\": %d,\n", LANE_WIDTH);
+    fprintf(out, "      \"hdr\": %s,\n", canvas.hdr ? "true" : "false");
+    fprintf(out, "      \"occlusion\": %s,\n", settings.occlusion ? "true" : "false");
+    fprintf(out, "      \"sort\": %s,\n", settings.sortInstances ? "true" : "false");
+    fprintf(out, "      \"visibility\": %s,\n", settings.visibility ? "true" : "false");
+    fprintf(out, "      \"frames\": %d,\n", options.frames);
+    fprintf(out, "      \"warmup_frames\": %d,\n", options.warmup);
+    fprintf(out, "      \"triangles_per_frame\": %llu,\n", (unsigned long long)lastStats.rasterizedTrianglesCount);
+    fprintf(out, "      \"vertices_processed_per_frame\": %llu,\n", (unsigned long long)lastStats.processedVerticesCount);
+    fprintf(out, "      \"triangles_per_sec\": %.1f,\n", trianglesPerSecond);
+    fprintf(out, "      \"pixels_per_sec\": %.1f,\n", pixelsPerSecond);
+    if(options.encode >= 0)
+    {
+        fprintf(out, "      \"encode\": \"%s\",\n", imageFormatNames[options.encode]);
+        fprintf(out, "      \"encode_level\": %d,\n", options.level);
+        fprintf(out, "      \"encoded_bytes\": %zu,\n", encoder.encoded.size());
+    }
+#if RENDER_STATS
+    if(settings.stats)
+    {
+        fprintf(out, "      \"counters\": {\n");
+        for(int c = 0; c < COUNTERS_COUNT; ++c)
+            fprintf(out, "        \"%s\": %llu%s\n", counterNames[c], (unsigned long long)pipelineStats.Get(c), c + 1 < COUNTERS_COUNT ? "," : "");
+        fprintf(out, "      },\n");
+    }
+#endif
+    fprintf(out, "      \"stages\": {\n");
+    for(int stage = 0; stage < RENDER_STAGES_COUNT; ++stage)
+    {
+        TimingSummary summary = Summarize(stageSamples[stage]);
+        WriteTiming(out, stageNames[stage], summary, false);
+    }
+    if(options.encode >= 0)
+    {
+        TimingSummary encodeSummary = Summarize(encodeSamples);
+        WriteTiming(out, "encode", encodeSummary, false);
+    }
+    TimingSummary frameSummary = Summarize(frameSamples);
+    WriteTiming(out, "frame", frameSummary, true);
+    fprintf(out, "      }\n");
+    fprintf(out, "    }%s\n", last ? "" : ",");
+    
+    printf("%-6s %8d instances: median frame %.3f ms, %.0f triangles/s\n",
+           sceneNames[options.scene], instancesCount, 1000.0*frameSummary.median, trianglesPerSecond);
+}
+
+bool ParseOptions(int argc, char **argv, BenchmarkOptions &options)
+{
+    for(int i = 1; i < argc; ++i)
+    {
+        char *name = argv[i];
+        char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if(!value)
+            return false;
+        ++i;
+        
+        if(strcmp(name, "-scene") == 0)
+        {
+            options.scene = -1;
+            for(int s = 0; s < SCENES_COUNT; ++s)
+            {
+                if(strcmp(value, sceneNames[s]) == 0)
+                    options.scene = s;
+            }
+            if(options.scene < 0)
+                return false;
+        }
+        else if(strcmp(name, "-rasterizer") == 0)
+        {
+            options.tiles = (strncmp(value, "tiles", 5) == 0);
+            if(strcmp(value, "tiles") == 0 || strcmp(value, "edge") == 0)
+                options.rasterizer = RASTERIZER_EDGE_FUNCTION;
+            else if(strcmp(value, "tiles-fixed") == 0 || strcmp(value, "fixed") == 0)
+                options.rasterizer = RASTERIZER_FIXED_POINT;
+            else if(strcmp(value, "scanline") == 0)
+                options.rasterizer = RASTERIZER_SCANLINE;
+            else
+                return false;
+        }
+        else if(strcmp(name, "-layout") == 0)
+        {
+            if(strcmp(value, "linear") == 0)
+                options.layout = CANVAS_LAYOUT_LINEAR;
+            else if(strcmp(value, "tiled") == 0)
+                options.layout = CANVAS_LAYOUT_TILED;
+            else
+                return false;
+        }
+        else if(strcmp(name, "-depth") == 0)
+        {
+            options.depthFormat = -1;
+            for(int f = 0; f < DEPTH_FORMATS_COUNT; ++f)
+            {
+                if(strcmp(value, depthFormatNames[f]) == 0)
+                    options.depthFormat = f;
+            }
+            if(options.depthFormat < 0)
+                return false;
+        }
+        else if(strcmp(name, "-encode") == 0)
+        {
+            options.encode = -1;
+            for(int f = IMAGE_FORMAT_PNG; f <= IMAGE_FORMAT_QOI; ++f)
+            {
+                if(strcmp(value, imageFormatNames[f]) == 0)
+                    options.encode = f;
+            }
+            if(options.encode < 0)
+                return false;
+        }
+        else if(strcmp(name, "-level") == 0)
+            options.level = atoi(value);
+        else if(strcmp(name, "-instances") == 0)
+            options.instances = atoi(value);
+        else if(strcmp(name, "-sweep") == 0)
+            options.sweep = atoi(value);
+        else if(strcmp(name, "-frames") == 0)
+            options.frames = atoi(value);
+        else if(strcmp(name, "-warmup") == 0)
+            options.warmup = atoi(value);
+        else if(strcmp(name, "-seed") == 0)
+            options.seed = (u32)strtoul(value, NULL, 10);
+        else if(strcmp(name, "-threads") == 0)
+            options.threads = atoi(value);
+        else if(strcmp(name, "-width") == 0)
+            options.width = atoi(value);
+        else if(strcmp(name, "-height") == 0)
+            options.height = atoi(value);
+        else if(strcmp(name, "-stats") == 0)
+            options.stats = (atoi(value) != 0);
+        else if(strcmp(name, "-hdr") == 0)
+            options.hdr = (atoi(value) != 0);
+        else if(strcmp(name, "-occlusion") == 0)
+            options.occlusion = (atoi(value) != 0);
+        else if(strcmp(name, "-sort") == 0)
+            options.sort = (atoi(value) != 0);
+        else if(strcmp(name, "-visibility") == 0)
+            options.visibility = (atoi(value) != 0);
+        else if(strcmp(name, "-out") == 0)
+            options.out = value;
+        else
+            return false;
+    }
+    
+    return (options.instances > 0 && options.frames > 0 && options.warmup >= 0 &&
+            options.threads > 0 && options.width > 0 && options.height > 0);
+}
+
+int main(int argc, char **argv)
+{
+    BenchmarkOptions options;
+    if(!ParseOptions(argc, argv, options))
+    {
+        printf("usage: benchmark [-scene fox|sphere|grid|mixed|city] [-instances N | -sweep MAX] [-frames N]\n"
+               "                 [-warmup N] [-seed N] [-threads N] [-rasterizer tiles|tiles-fixed|edge|fixed|scanline]\n"
+               "                 [-width W] [-height H] [-layout linear|tiled] [-depth unorm16|unorm24|float32]\n"
+               "                 [-stats 0|1] [-hdr 0|1] [-occlusion 0|1] [-sort 0|1] [-visibility 0|1]\n"
+               "                 [-encode png|stbpng|qoi] [-level N] [-out file.json]\n");
+        return 1;
+    }
+    
+    Mesh fox;
+    Mesh sphere;
+    Mesh grid;
+    {
+        WorkerPool loadPool((int)std::thread::hardware_concurrency());
+        if(!LoadObj(&fox, "../models/fox.obj", "../models/", loadPool) ||
+           !LoadObj(&sphere, "../models/sphere.obj", "../models/", loadPool))
+            return 1;
+    }
+    MakeGridMesh(&grid, 32);
+    Mesh *meshes[SCENE_MIXED] = {&fox, &sphere, &grid};
+    
+    vector<int> counts;
+    if(options.sweep > 0)
+    {
+        for(int count = 10; count <= options.sweep; count *= 10)
+            counts.push_back(count);
+    }
+    else
+    {
+        counts.push_back(options.instances);
+    }
+    
+    FILE *out = OpenFile(options.out, "w");
+    if(!out)
+    {
+        printf("ERR: Could not open %s\n", options.out);
+        return 1;
+    }
+    
+    fprintf(out, "{\n  \"runs\": [\n");
+    for(size_t i = 0; i < counts.size(); ++i)
+        RunBenchmark(out, options, counts[i], meshes, i + 1 == counts.size());
+    fprintf(out, "  ]\n}\n");
+    fclose(out);
+    
+    printf("Results written to %s\n", options.out);
+#if PROFILER
+    if(WriteProfilerTrace("trace.json"))
+        printf("Profiler trace written to trace.json\n");
+#endif
+    return 0;
+}
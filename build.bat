@@ -1,12 +1,15 @@
 @echo off
 
-set compilerFlags=-std:c++17 -EHsc -Ox -Zi -nologo -FC -WX -W4 -wd4100 -wd4189 -wd4239 -wd4201 -wd4505 -wd4702 -wd4700
+set compilerFlags=-std:c++17 -EHsc -Ox -Zi -nologo -FC -WX -W4 -wd4100 -wd4189 -wd4239 -wd4201 -wd4505 -wd4702 -wd4700 -wd4324
 
 pushd ..\build
 
 cl %compilerFlags% ..\code\main.cpp  -link -opt:ref -incremental:no
+cl %compilerFlags% ..\code\benchmark.cpp  -link -opt:ref -incremental:no
 
 popd
 
 REM -Fe[name] is the compiler flag to rename the executable
+REM -DANIMATION_FRAMES=[count] renders an animation to ../renders/frame_*.png instead of one image
+REM -DPROFILER=1 records the timed zones and writes ../renders/trace.json (chrome://tracing, ui.perfetto.dev)
 REM -Ox instead of -Od for the optimized build
\ No newline at end of file
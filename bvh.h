@@ -0,0 +1,241 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <algorithm>
+
+struct AABB
+{
+    p3 min;
+    p3 max;
+};
+
+inline AABB Union(AABB &a, AABB &b)
+{
+    AABB result;
+    for(int i = 0; i < 3; ++i)
+    {
+        result.min.e[i] = Min(a.min.e[i], b.min.e[i]);
+        result.max.e[i] = Max(a.max.e[i], b.max.e[i]);
+    }
+    return result;
+}
+
+inline AABB SphereBounds(Sphere &s)
+{
+    AABB result;
+    result.min = p3(s.center.x - s.r, s.center.y - s.r, s.center.z - s.r);
+    result.max = p3(s.center.x + s.r, s.center.y + s.r, s.center.z + s.r);
+    return result;
+}
+
+struct BVHNode
+{
+    AABB bounds;
+    // NOTE(mevex): For a leaf first indexes BVH::instanceIndices and count > 0,
+    //              for an inner node first is the left child, the right one follows it, and count == 0
+    u32 first;
+    u32 count;
+};
+
+struct VisibleInstance
+{
+    u32 index;
+    // NOTE(mevex): Set when the instance is inside all the clipping planes, so it needs no further tests
+    bool insideFrustum;
+};
+
+#define BVH_LEAF_SIZE 4
+
+// NOTE(mevex): Bounding volume hierarchy of the instances in world space. Built once, then
+//              Refit must be called after moving instances (it keeps the topology and only
+//              recomputes the bounds). The frustum culling rejects whole subtrees at once.
+class InstanceBVH
+{
+    public:
+    
+    vector<BVHNode> nodes;
+    vector<u32> instanceIndices;
+    vector<AABB> instanceBounds;
+    vector<p3> centroids;
+    
+    void Build(vector<Instance> &instances)
+    {
+        u32 instancesCount = (u32)instances.size();
+        nodes.clear();
+        instanceIndices.resize(instancesCount);
+        instanceBounds.resize(instancesCount);
+        centroids.resize(instancesCount);
+        
+        for(u32 i = 0; i < instancesCount; ++i)
+        {
+            Sphere s = instances[i].WorldBoundingSphere();
+            instanceBounds[i] = SphereBounds(s);
+            centroids[i] = s.center;
+            instanceIndices[i] = i;
+        }
+        
+        if(instancesCount == 0)
+            return;
+        
+        nodes.reserve(2 * instancesCount);
+        nodes.push_back({});
+        Subdivide(0, 0, instancesCount);
+    }
+    
+    // NOTE(mevex): Splits at the median of the longest axis of the centroids
+    void Subdivide(u32 nodeIndex, u32 first, u32 count)
+    {
+        AABB bounds = instanceBounds[instanceIndices[first]];
+        AABB centroidBounds = {centroids[instanceIndices[first]], centroids[instanceIndices[first]]};
+        for(u32 i = first + 1; i < first + count; ++i)
+        {
+            u32 instance = instanceIndices[i];
+            bounds = Union(bounds, instanceBounds[instance]);
+            AABB centroid = {centroids[instance], centroids[instance]};
+            centroidBounds = Union(centroidBounds, centroid);
+        }
+        nodes[nodeIndex].bounds = bounds;
+        
+        if(count <= BVH_LEAF_SIZE)
+        {
+            nodes[nodeIndex].first = first;
+            nodes[nodeIndex].count = count;
+            return;
+        }
+        
+        v3 extent = centroidBounds.max - centroidBounds.min;
+        int axis = X;
+        if(extent.y > extent.e[axis])
+            axis = Y;
+        if(extent.z > extent.e[axis])
+            axis = Z;
+        
+        u32 half = count / 2;
+        u32 *begin = instanceIndices.data() + first;
+        std::nth_element(begin, begin + half, begin + count, [&](u32 a, u32 b)
+                         {
+                             return centroids[a].e[axis] < centroids[b].e[axis];
+                         });
+        
+        u32 left = (u32)nodes.size();
+        nodes.push_back({});
+        nodes.push_back({});
+        nodes[nodeIndex].first = left;
+        nodes[nodeIndex].count = 0;
+        
+        Subdivide(left, first, half);
+        Subdivide(left + 1, first + half, count - half);
+    }
+    
+    void Refit(vector<Instance> &instances)
+    {
+        Assert(instances.size() == instanceBounds.size());
+        for(u32 i = 0; i < (u32)instances.size(); ++i)
+        {
+            Sphere s = instances[i].WorldBoundingSphere();
+            instanceBounds[i] = SphereBounds(s);
+            centroids[i] = s.center;
+        }
+        
+        // NOTE(mevex): Children are always stored after their parent, so walking backwards
+        //              updates every node after its children
+        for(size_t n = nodes.size(); n > 0; --n)
+        {
+            BVHNode &node = nodes[n - 1];
+            if(node.count)
+            {
+                AABB bounds = instanceBounds[instanceIndices[node.first]];
+                for(u32 i = node.first + 1; i < node.first + node.count; ++i)
+                    bounds = Union(bounds, instanceBounds[instanceIndices[i]]);
+                node.bounds = bounds;
+            }
+            else
+            {
+                node.bounds = Union(nodes[node.first].bounds, nodes[node.first + 1].bounds);
+            }
+        }
+    }
+    
+    // NOTE(mevex): Collects the instances whose bounds touch the frustum.
+    //              planes must be in world space, see WorldClippingPlanes.
+    void CullFrustum(Plane *planes, int planesCount, FixedArray<VisibleInstance> &visible)
+    {
+        if(nodes.empty())
+            return;
+        
+        struct StackEntry
+        {
+            u32 node;
+            u32 planesMask;
+        };
+        
+        StackEntry stack[64];
+        int stackCount = 0;
+        stack[stackCount++] = {0, (1u << planesCount) - 1};
+        
+        while(stackCount)
+        {
+            StackEntry entry = stack[--stackCount];
+            BVHNode &node = nodes[entry.node];
+            
+            // NOTE(mevex): Only the planes that intersected the parent need to be tested
+            u32 mask = entry.planesMask;
+            bool outside = false;
+            for(int p = 0; p < planesCount; ++p)
+            {
+                if(!(mask & (1u << p)))
+                    continue;
+                
+                Plane &plane = planes[p];
+                p3 nearest;
+                p3 farthest;
+                for(int i = 0; i < 3; ++i)
+                {
+                    bool positive = plane.normal.e[i] >= 0;
+                    farthest.e[i] = positive ? node.bounds.max.e[i] : node.bounds.min.e[i];
+                    nearest.e[i] = positive ? node.bounds.min.e[i] : node.bounds.max.e[i];
+                }
+                
+                if(Dot(farthest, plane.normal) + plane.d < 0)
+                {
+                    outside = true;
+                    break;
+                }
+                if(Dot(nearest, plane.normal) + plane.d >= 0)
+                    mask &= ~(1u << p);
+            }
+            if(outside)
+                continue;
+            
+            if(node.count)
+            {
+                for(u32 i = node.first; i < node.first + node.count; ++i)
+                    visible.Add({instanceIndices[i], mask == 0});
+            }
+            else
+            {
+                Assert(stackCount + 2 <= 64);
+                stack[stackCount++] = {node.first + 1, mask};
+                stack[stackCount++] = {node.first, mask};
+            }
+        }
+    }
+};
+
+// NOTE(mevex): The clipping planes of the camera are in camera space, p_cam = A*p_world + b.
+//              A plane n.p_cam + d = 0 becomes (A^T n).p_world + (n.b + d) = 0 in world space.
+void WorldClippingPlanes(Camera &cam, Plane *planes)
+{
+    m4x4 &m = cam.transform;
+    for(int p = 0; p < CLIPPING_PLANES_COUNT; ++p)
+    {
+        v3 n = cam.clippingPlanes[p].normal;
+        Plane result;
+        for(int i = 0; i < 3; ++i)
+            result.normal.e[i] = m.e[0][i]*n.x + m.e[1][i]*n.y + m.e[2][i]*n.z;
+        result.d = n.x*m.e[0][3] + n.y*m.e[1][3] + n.z*m.e[2][3] + cam.clippingPlanes[p].d;
+        planes[p] = result;
+    }
+}
+
+#endif //BVH_H
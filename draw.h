@@ -2,6 +2,7 @@
 #define CANVAS_H
 
 #include "v3.h"
+#include "simd.h"
 
 #include <vector>
 using std::vector;
@@ -93,7 +94,10 @@ inline void DrawLine(p3 p0, p3 p1, Color c, Canvas &canvas)
     DrawLine(x0, y0, x1, y1, c, canvas);
 }
 
-void DrawFilledTriangle(int x0, int y0, f32 z0, int x1, int y1, f32 z1, int x2, int y2, f32 z2, f32 i0, f32 i1, f32 i2, Color c, Canvas &canvas)
+// NOTE(mevex): With ids the pixels that pass the depth test get id instead of a color, see visibility.h
+//              Returns the number of pixels that passed the depth test, like the other rasterizers.
+u64 DrawFilledTriangle(int x0, int y0, f32 z0, int x1, int y1, f32 z1, int x2, int y2, f32 z2, f32 i0, f32 i1, f32 i2, Color c, Canvas &canvas,
+                       ThreadCounters *counters = NULL, u32 *ids = NULL, u32 id = 0)
 {
     // NOTE(mevex): compute the x coordinates of the edges
     vector<int> x01 = Interpolate(y0, x0, y1, x1);
@@ -149,35 +153,62 @@ void DrawFilledTriangle(int x0, int y0, f32 z0, int x1, int y1, f32 z1, int x2,
         iRight = &i012;
     }
     
-    // NOTE(mevex): Draw the horizontal segments
+    // NOTE(mevex): Draw the horizontal segments. Triangles in the guard band can reach outside
+    //              of the canvas, so rows and segments are scissored to it.
+    u64 pixelsTested = 0;
+    u64 pixelsWritten = 0;
+    PixelLayout layout = canvas.layout;
     for(int y = y0; y <= y2; y++)
     {
+        if(y < 0 || y >= canvas.height)
+            continue;
+        
         int xL = xLeft->at(y - y0);
         int xR = xRight->at(y - y0);
         f32 iL = iLeft->at(y - y0);
         f32 iR = iRight->at(y - y0);
         f32 zL = zLeft->at(y - y0);
         f32 zR = zRight->at(y - y0);
-        f32 *zBufferLocation = canvas.zBuffer + y*canvas.width + xL;
+        int xStart = Max(xL, 0);
+        int xEnd = Min(xR, canvas.width - 1);
+        size_t rowOffset = layout.Row(y);
         
         vector<f32> iSegment = Interpolate(xL, iL, xR, iR);
         vector<f32> zSegment = Interpolate(xL, zL, xR, zR);
-        for(int x = xL; x <= xR; x++)
+        for(int x = xStart; x <= xEnd; x++)
         {
             //Color shade = c * hSegment[x - xL];
             f32 z = zSegment[x - xL];
             f32 i = iSegment[x - xL];
-            if(z < *zBufferLocation)
+            size_t offset = rowOffset + layout.Column(x);
+            ++pixelsTested;
+            if(canvas.DepthTest(offset, z))
             {
-                canvas.SetPixel(x, y, c*i);
-                *zBufferLocation = z;
+                if(ids)
+                    ids[offset] = id;
+                else
+                    canvas.WritePixel(offset, c*i);
+                
+                ++pixelsWritten;
+#if RENDER_STATS
+                if(counters && counters->overdraw)
+                    ++counters->overdraw[y*canvas.width + x];
+#endif
             }
-            ++zBufferLocation;
         }
     }
+    
+    CountStat(counters, COUNTER_PIXELS_TESTED, pixelsTested);
+    CountStat(counters, COUNTER_PIXELS_DEPTH_REJECTED, pixelsTested - pixelsWritten);
+    CountStat(counters, COUNTER_PIXELS_WRITTEN, pixelsWritten);
+    if(!ids)
+        CountStat(counters, COUNTER_PIXELS_SHADED, pixelsWritten);
+    
+    return pixelsWritten;
 }
 
-inline void DrawFilledTriangle(p3 p0, p3 p1, p3 p2, f32 i0, f32 i1, f32 i2, Color c, Canvas &canvas)
+inline u64 DrawFilledTriangle(p3 p0, p3 p1, p3 p2, f32 i0, f32 i1, f32 i2, Color c, Canvas &canvas,
+                              ThreadCounters *counters = NULL, u32 *ids = NULL, u32 id = 0)
 {
     // NOTE(mevex): Sort the points so that y0 <= y1 <= y2
     if(p0.y > p1.y)
@@ -202,11 +233,673 @@ inline void DrawFilledTriangle(p3 p0, p3 p1, p3 p2, f32 i0, f32 i1, f32 i2, Colo
     int y0 = int(p0.y + 0.5f);
     int y1 = int(p1.y + 0.5f);
     int y2 = int(p2.y + 0.5f);
-    f32 z1 = p1.z;
-    f32 z0 = p0.z;
-    f32 z2 = p2.z;
+    // NOTE(mevex): The reverse depth, 1/w is the one that can be interpolated in screen space
+    f32 z0 = 1.0f / p0.z;
+    f32 z1 = 1.0f / p1.z;
+    f32 z2 = 1.0f / p2.z;
+    
+    return DrawFilledTriangle(x0, y0, z0, x1, y1, z1, x2, y2, z2, i0, i1, i2, c, canvas, counters, ids, id);
+}
+
+// NOTE(mevex): A triangle ready for the rasterizer: projected vertices, per vertex intensity and color
+struct ScreenTriangle
+{
+    p3 p0, p1, p2;
+    f32 i0, i1, i2;
+    Color color;
+};
+
+inline f32 EdgeFunction(f32 ax, f32 ay, f32 bx, f32 by, f32 px, f32 py)
+{
+    // NOTE(mevex): Twice the signed area of the triangle abp,
+    //              positive when p lies on the left of the edge ab
+    f32 result = (bx - ax)*(py - ay) - (by - ay)*(px - ax);
+    return result;
+}
+
+// NOTE(mevex): Edge ab of a counter-clockwise triangle, y up. A top edge is horizontal with the
+//              inside below it, so it goes to the left, and a left edge goes down.
+inline bool IsTopLeftEdge(f32 ax, f32 ay, f32 bx, f32 by)
+{
+    bool result = (ay == by && bx < ax) || (by < ay);
+    return result;
+}
+
+// NOTE(mevex): Intensity of a triangle the way a rasterizer evaluates it, from the origin of the plane
+//              to the row and then to the pixel. VisibilityBuffer::Shade sets up the same plane as the
+//              rasterizer that drew the frame, so it gets the very intensity that would have been written.
+struct IntensityPlane
+{
+    f32 x0;
+    f32 y0;
+    f32 i0;
+    f32 idx;
+    f32 idy;
+    
+    inline f32 Row(i32 y)
+    {
+        f32 result = i0 + idy*((f32)y - y0);
+        return result;
+    }
+    
+    inline f32 At(f32 row, i32 x)
+    {
+        f32 result = row + idx*((f32)x - x0);
+        return result;
+    }
+};
+
+// NOTE(mevex): p0 p1 p2 counter-clockwise, start is the first pixel of the bounding box
+inline IntensityPlane EdgeIntensityPlane(p3 p0, p3 p1, p3 p2, f32 i0, f32 i1, f32 i2, f32 invArea, f32 startX, f32 startY)
+{
+    f32 w0 = EdgeFunction(p1.x, p1.y, p2.x, p2.y, startX, startY);
+    f32 w1 = EdgeFunction(p2.x, p2.y, p0.x, p0.y, startX, startY);
+    f32 w2 = EdgeFunction(p0.x, p0.y, p1.x, p1.y, startX, startY);
+    
+    IntensityPlane result;
+    result.x0 = startX;
+    result.y0 = startY;
+    result.i0 = (w0*i0 + w1*i1 + w2*i2) * invArea;
+    result.idx = ((p1.y - p2.y)*i0 + (p2.y - p0.y)*i1 + (p0.y - p1.y)*i2) * invArea;
+    result.idy = ((p2.x - p1.x)*i0 + (p0.x - p2.x)*i1 + (p1.x - p0.x)*i2) * invArea;
+    return result;
+}
+
+// NOTE(mevex): The plane RasterizeTriangleEdge sets up for t, false when it draws nothing
+inline bool EdgeIntensityPlane(ScreenTriangle &t, IntensityPlane &plane)
+{
+    p3 p0 = t.p0;
+    p3 p1 = t.p1;
+    p3 p2 = t.p2;
+    f32 i1 = t.i1;
+    f32 i2 = t.i2;
+    
+    f32 area = EdgeFunction(p0.x, p0.y, p1.x, p1.y, p2.x, p2.y);
+    if(Abs(area) < ZERO)
+        return false;
+    
+    if(area < 0)
+    {
+        Swap(p1, p2);
+        Swap(i1, i2);
+        area = -area;
+    }
+    
+    f32 minXf = Min(p0.x, Min(p1.x, p2.x));
+    f32 minYf = Min(p0.y, Min(p1.y, p2.y));
+    f32 startX = (f32)(i32)ceil(minXf);
+    f32 startY = (f32)(i32)ceil(minYf);
+    plane = EdgeIntensityPlane(p0, p1, p2, t.i0, i1, i2, 1.0f / area, startX, startY);
+    return true;
+}
+
+// NOTE(mevex): Half-space rasterizer. It walks the bounding box of the triangle and
+//              interpolates barycentrics, depth and intensity, without allocations.
+//              Pixel centers are at integer coordinates, same as the scanline version.
+//              Only the pixels inside the inclusive rectangle clipMin-clipMax are touched.
+//              Everything is evaluated at each pixel from the corner of the whole bounding box,
+//              not stepped from the corner of the rectangle, so a tile gets the very pixels and
+//              values of the full draw. A pixel center right on an edge belongs to the triangle
+//              only for its top and left edges.
+//              With ids the pixels that pass the depth test get id instead of a color, see visibility.h
+template <int depthFormat>
+u64 RasterizeTriangleEdge(p3 p0, p3 p1, p3 p2, f32 i0, f32 i1, f32 i2, Color c, Canvas &canvas,
+                          i32 clipMinX, i32 clipMinY, i32 clipMaxX, i32 clipMaxY, ThreadCounters *counters, u32 *ids, u32 id)
+{
+    f32 area = EdgeFunction(p0.x, p0.y, p1.x, p1.y, p2.x, p2.y);
+    if(Abs(area) < ZERO)
+        return 0;
+    
+    // NOTE(mevex): Make the winding counter-clockwise so that inside means all weights positive
+    if(area < 0)
+    {
+        Swap(p1, p2);
+        Swap(i1, i2);
+        area = -area;
+    }
+    
+    f32 minXf = Min(p0.x, Min(p1.x, p2.x));
+    f32 maxXf = Max(p0.x, Max(p1.x, p2.x));
+    f32 minYf = Min(p0.y, Min(p1.y, p2.y));
+    f32 maxYf = Max(p0.y, Max(p1.y, p2.y));
+    
+    i32 originX = (i32)ceil(minXf);
+    i32 originY = (i32)ceil(minYf);
+    i32 minX = Max(originX, clipMinX);
+    i32 maxX = Min((i32)floor(maxXf), clipMaxX);
+    i32 minY = Max(originY, clipMinY);
+    i32 maxY = Min((i32)floor(maxYf), clipMaxY);
+    if(minX > maxX || minY > maxY)
+        return 0;
+    
+    // NOTE(mevex): Weights at the first pixel of the bounding box, w0 belongs to p0 and so on
+    f32 startX = (f32)originX;
+    f32 startY = (f32)originY;
+    f32 w0Origin = EdgeFunction(p1.x, p1.y, p2.x, p2.y, startX, startY);
+    f32 w1Origin = EdgeFunction(p2.x, p2.y, p0.x, p0.y, startX, startY);
+    f32 w2Origin = EdgeFunction(p0.x, p0.y, p1.x, p1.y, startX, startY);
+    bool topLeft0 = IsTopLeftEdge(p1.x, p1.y, p2.x, p2.y);
+    bool topLeft1 = IsTopLeftEdge(p2.x, p2.y, p0.x, p0.y);
+    bool topLeft2 = IsTopLeftEdge(p0.x, p0.y, p1.x, p1.y);
+    
+    // NOTE(mevex): Weights changes for one pixel to the right (dx) and one pixel up (dy)
+    f32 w0dx = p1.y - p2.y;
+    f32 w1dx = p2.y - p0.y;
+    f32 w2dx = p0.y - p1.y;
+    f32 w0dy = p2.x - p1.x;
+    f32 w1dy = p0.x - p2.x;
+    f32 w2dy = p1.x - p0.x;
+    
+    // NOTE(mevex): The reverse depth 1/w and the intensity are affine in screen space too
+    f32 invArea = 1.0f / area;
+    f32 z0 = 1.0f / p0.z;
+    f32 z1 = 1.0f / p1.z;
+    f32 z2 = 1.0f / p2.z;
+    f32 zOrigin = (w0Origin*z0 + w1Origin*z1 + w2Origin*z2) * invArea;
+    f32 zdx = (w0dx*z0 + w1dx*z1 + w2dx*z2) * invArea;
+    f32 zdy = (w0dy*z0 + w1dy*z1 + w2dy*z2) * invArea;
+    IntensityPlane intensity = EdgeIntensityPlane(p0, p1, p2, i0, i1, i2, invArea, startX, startY);
+    
+    u64 pixelsTested = 0;
+    u64 pixelsWritten = 0;
+    PixelLayout layout = canvas.layout;
+    void *zBuffer = canvas.zBuffer;
+    for(i32 y = minY; y <= maxY; y++)
+    {
+        f32 dy = (f32)(y - originY);
+        f32 w0Row = w0Origin + w0dy*dy;
+        f32 w1Row = w1Origin + w1dy*dy;
+        f32 w2Row = w2Origin + w2dy*dy;
+        f32 zRow = zOrigin + zdy*dy;
+        f32 iRow = intensity.Row(y);
+        size_t rowOffset = layout.Row(y);
+        
+        for(i32 x = minX; x <= maxX; x++)
+        {
+            f32 dx = (f32)(x - originX);
+            f32 w0 = w0Row + w0dx*dx;
+            f32 w1 = w1Row + w1dx*dx;
+            f32 w2 = w2Row + w2dx*dx;
+            if((w0 > 0 || (w0 == 0 && topLeft0)) &&
+               (w1 > 0 || (w1 == 0 && topLeft1)) &&
+               (w2 > 0 || (w2 == 0 && topLeft2)))
+            {
+                size_t offset = rowOffset + layout.Column(x);
+                ++pixelsTested;
+                if(DepthTest<depthFormat>(zBuffer, offset, zRow + zdx*dx))
+                {
+                    if(ids)
+                        ids[offset] = id;
+                    else
+                        canvas.WritePixel(offset, c*intensity.At(iRow, x));
+                    
+                    ++pixelsWritten;
+#if RENDER_STATS
+                    if(counters && counters->overdraw)
+                        ++counters->overdraw[y*canvas.width + x];
+#endif
+                }
+            }
+        }
+    }
+    
+    CountStat(counters, COUNTER_PIXELS_TESTED, pixelsTested);
+    CountStat(counters, COUNTER_PIXELS_DEPTH_REJECTED, pixelsTested - pixelsWritten);
+    CountStat(counters, COUNTER_PIXELS_WRITTEN, pixelsWritten);
+    if(!ids)
+        CountStat(counters, COUNTER_PIXELS_SHADED, pixelsWritten);
+    
+    return pixelsWritten;
+}
+
+u64 DrawFilledTriangleEdge(p3 p0, p3 p1, p3 p2, f32 i0, f32 i1, f32 i2, Color c, Canvas &canvas,
+                           i32 clipMinX, i32 clipMinY, i32 clipMaxX, i32 clipMaxY,
+                           ThreadCounters *counters = NULL, u32 *ids = NULL, u32 id = 0)
+{
+    switch(canvas.depthFormat)
+    {
+        case DEPTH_FORMAT_UNORM16:
+            return RasterizeTriangleEdge<DEPTH_FORMAT_UNORM16>(p0, p1, p2, i0, i1, i2, c, canvas, clipMinX, clipMinY, clipMaxX, clipMaxY, counters, ids, id);
+        case DEPTH_FORMAT_UNORM24:
+            return RasterizeTriangleEdge<DEPTH_FORMAT_UNORM24>(p0, p1, p2, i0, i1, i2, c, canvas, clipMinX, clipMinY, clipMaxX, clipMaxY, counters, ids, id);
+        default:
+            return RasterizeTriangleEdge<DEPTH_FORMAT_FLOAT32>(p0, p1, p2, i0, i1, i2, c, canvas, clipMinX, clipMinY, clipMaxX, clipMaxY, counters, ids, id);
+    }
+}
+
+inline u64 DrawFilledTriangleEdge(p3 p0, p3 p1, p3 p2, f32 i0, f32 i1, f32 i2, Color c, Canvas &canvas,
+                                  ThreadCounters *counters = NULL, u32 *ids = NULL, u32 id = 0)
+{
+    return DrawFilledTriangleEdge(p0, p1, p2, i0, i1, i2, c, canvas, 0, 0, canvas.width - 1, canvas.height - 1, counters, ids, id);
+}
+
+// NOTE(mevex): Bits of sub-pixel precision of the fixed point rasterizer
+#define SUBPIXEL_BITS 8
+#define SUBPIXEL_ONE (1 << SUBPIXEL_BITS)
+
+inline i64 SnapToSubpixel(f32 v)
+{
+    i64 result = (i64)floorf(v * SUBPIXEL_ONE + 0.5f);
+    return result;
+}
+
+inline i64 EdgeFunctionFixed(i64 ax, i64 ay, i64 bx, i64 by, i64 px, i64 py)
+{
+    i64 result = (bx - ax)*(py - ay) - (by - ay)*(px - ax);
+    return result;
+}
+
+// NOTE(mevex): Same rule as the float version, on the snapped vertices
+inline bool IsTopLeftEdge(i64 ax, i64 ay, i64 bx, i64 by)
+{
+    bool result = (ay == by && bx < ax) || (by < ay);
+    return result;
+}
+
+// NOTE(mevex): Side of the blocks the fixed point rasterizer sorts against the edges, the same as the
+//              blocks of the tiled layout so that a row of a block is contiguous in both layouts
+#define RASTER_BLOCK_SHIFT CANVAS_BLOCK_SHIFT
+#define RASTER_BLOCK_SIZE (1 << RASTER_BLOCK_SHIFT)
+
+// NOTE(mevex): A triangle set up by RasterizeTriangleFixed. The edge functions are biased by the
+//              top-left rule, so a pixel center is inside when the three are not negative.
+struct FixedTriangle
+{
+    i32 originX;
+    i32 originY;
+    i64 w0;
+    i64 w1;
+    i64 w2;
+    i64 w0dx;
+    i64 w1dx;
+    i64 w2dx;
+    i64 w0dy;
+    i64 w1dy;
+    i64 w2dy;
+    
+    // NOTE(mevex): Planes of the reverse depth and of the intensity, from the first snapped vertex
+    f32 x0;
+    f32 y0;
+    f32 z0;
+    f32 zdx;
+    f32 zdy;
+    f32 i0;
+    f32 idx;
+    f32 idy;
+    
+    Color c;
+    u32 *ids;
+    u32 id;
+    u64 pixelsTested;
+    u64 pixelsWritten;
+};
+
+inline void FixedEdgesAt(FixedTriangle &t, i32 x, i32 y, i64 &w0, i64 &w1, i64 &w2)
+{
+    i64 dx = x - t.originX;
+    i64 dy = y - t.originY;
+    w0 = t.w0 + dx*t.w0dx + dy*t.w0dy;
+    w1 = t.w1 + dx*t.w1dx + dy*t.w1dy;
+    w2 = t.w2 + dx*t.w2dx + dy*t.w2dy;
+}
+
+template <int depthFormat>
+inline bool ShadeFixedPixel(FixedTriangle &t, Canvas &canvas, size_t offset, i32 x, i32 y, f32 z, f32 i, ThreadCounters *counters)
+{
+    if(!DepthTest<depthFormat>(canvas.zBuffer, offset, z))
+        return false;
+    
+    if(t.ids)
+        t.ids[offset] = t.id;
+    else
+        canvas.WritePixel(offset, t.c*i);
+    
+#if RENDER_STATS
+    if(counters && counters->overdraw)
+        ++counters->overdraw[y*canvas.width + x];
+#endif
+    return true;
+}
+
+// NOTE(mevex): Walks the inclusive rectangle testing every pixel center against the edges
+template <int depthFormat>
+void RasterizeFixedRect(FixedTriangle &triangle, Canvas &canvas, i32 minX, i32 minY, i32 maxX, i32 maxY, ThreadCounters *counters)
+{
+    // NOTE(mevex): A copy can stay in registers, the writes to the canvas could change the original
+    FixedTriangle t = triangle;
+    i64 w0Row;
+    i64 w1Row;
+    i64 w2Row;
+    FixedEdgesAt(t, minX, minY, w0Row, w1Row, w2Row);
+    
+    u64 pixelsTested = 0;
+    u64 pixelsWritten = 0;
+    PixelLayout layout = canvas.layout;
+    for(i32 y = minY; y <= maxY; y++)
+    {
+        i64 w0 = w0Row;
+        i64 w1 = w1Row;
+        i64 w2 = w2Row;
+        f32 zBase = t.z0 + t.zdy*((f32)y - t.y0);
+        f32 iBase = t.i0 + t.idy*((f32)y - t.y0);
+        size_t rowOffset = layout.Row(y);
+        
+        for(i32 x = minX; x <= maxX; x++)
+        {
+            if((w0 | w1 | w2) >= 0)
+            {
+                f32 dx = (f32)x - t.x0;
+                ++pixelsTested;
+                if(ShadeFixedPixel<depthFormat>(t, canvas, rowOffset + layout.Column(x), x, y, zBase + t.zdx*dx, iBase + t.idx*dx, counters))
+                    ++pixelsWritten;
+            }
+            
+            w0 += t.w0dx;
+            w1 += t.w1dx;
+            w2 += t.w2dx;
+        }
+        
+        w0Row += t.w0dy;
+        w1Row += t.w1dy;
+        w2Row += t.w2dy;
+    }
+    
+    triangle.pixelsTested += pixelsTested;
+    triangle.pixelsWritten += pixelsWritten;
+}
+
+// NOTE(mevex): Fills a rectangle inside one block that the triangle covers completely, so there are
+//              no edges to test. With the float depth LANE_WIDTH pixels are tested and written at
+//              a time, and they come out the same as from RasterizeFixedRect, lane by lane.
+template <int depthFormat>
+void FillFixedRect(FixedTriangle &t, Canvas &canvas, i32 minX, i32 minY, i32 maxX, i32 maxY, ThreadCounters *counters)
+{
+    i32 count = maxX - minX + 1;
+    t.pixelsTested += (u64)count * (maxY - minY + 1);
+    
+    PixelLayout layout = canvas.layout;
+    for(i32 y = minY; y <= maxY; y++)
+    {
+        f32 zBase = t.z0 + t.zdy*((f32)y - t.y0);
+        f32 iBase = t.i0 + t.idy*((f32)y - t.y0);
+        size_t offset = layout.Offset(minX, y);
+        i32 i = 0;
+        
+        if constexpr(depthFormat == DEPTH_FORMAT_FLOAT32)
+        {
+            f32 *depth = (f32 *)canvas.zBuffer + offset;
+            lane_f32 wideZBase = LaneSet1(zBase);
+            lane_f32 wideZdx = LaneSet1(t.zdx);
+            lane_f32 wideX0 = LaneSet1(t.x0);
+            lane_f32 indices = LaneIndices();
+            lane_f32 wideIBase = LaneSet1(iBase);
+            lane_f32 wideIdx = LaneSet1(t.idx);
+            lane_f32 red = LaneSet1(t.c.r);
+            lane_f32 green = LaneSet1(t.c.g);
+            lane_f32 blue = LaneSet1(t.c.b);
+            for(; i + LANE_WIDTH <= count; i += LANE_WIDTH)
+            {
+                lane_f32 dx = LaneSub(LaneAdd(LaneSet1((f32)(minX + i)), indices), wideX0);
+                lane_f32 z = LaneAdd(wideZBase, LaneMul(wideZdx, dx));
+                lane_f32 old = LaneLoad(depth + i);
+                lane_f32 pass = LaneGreater(z, old);
+                int mask = LaneMoveMask(pass);
+                if(!mask)
+                    continue;
+                
+                LaneStore(depth + i, LaneSelect(pass, z, old));
+                if(t.ids)
+                {
+                    for(i32 lane = 0; lane < LANE_WIDTH; ++lane)
+                    {
+                        if(mask & (1 << lane))
+                            t.ids[offset + i + lane] = t.id;
+                    }
+                }
+                else
+                {
+                    lane_f32 intensity = LaneAdd(wideIBase, LaneMul(wideIdx, dx));
+                    canvas.WritePixels(offset + i, LaneMul(red, intensity), LaneMul(green, intensity), LaneMul(blue, intensity), mask);
+                }
+                
+                for(i32 lane = 0; lane < LANE_WIDTH; ++lane)
+                {
+                    if(!(mask & (1 << lane)))
+                        continue;
+                    
+                    ++t.pixelsWritten;
+#if RENDER_STATS
+                    if(counters && counters->overdraw)
+                        ++counters->overdraw[y*canvas.width + minX + i + lane];
+#endif
+                }
+            }
+        }
+        
+        // NOTE(mevex): Leftover pixels, and every pixel of the unorm formats
+        for(; i < count; ++i)
+        {
+            f32 dx = (f32)(minX + i) - t.x0;
+            if(ShadeFixedPixel<depthFormat>(t, canvas, offset + i, minX + i, y, zBase + t.zdx*dx, iBase + t.idx*dx, counters))
+                ++t.pixelsWritten;
+        }
+    }
+}
+
+// NOTE(mevex): Plane through the snapped vertices, in pixels, counter-clockwise.
+//              invArea is the inverse of the area in pixels.
+inline IntensityPlane FixedIntensityPlane(f32 fx0, f32 fy0, f32 fx1, f32 fy1, f32 fx2, f32 fy2, f32 i0, f32 i1, f32 i2, f32 invArea)
+{
+    IntensityPlane result;
+    result.x0 = fx0;
+    result.y0 = fy0;
+    result.i0 = i0;
+    result.idx = ((fy1 - fy2)*i0 + (fy2 - fy0)*i1 + (fy0 - fy1)*i2) * invArea;
+    result.idy = ((fx2 - fx1)*i0 + (fx0 - fx2)*i1 + (fx1 - fx0)*i2) * invArea;
+    return result;
+}
+
+// NOTE(mevex): The plane RasterizeTriangleFixed sets up for t, false when it draws nothing
+inline bool FixedIntensityPlane(ScreenTriangle &t, IntensityPlane &plane)
+{
+    i64 x0 = SnapToSubpixel(t.p0.x);
+    i64 y0 = SnapToSubpixel(t.p0.y);
+    i64 x1 = SnapToSubpixel(t.p1.x);
+    i64 y1 = SnapToSubpixel(t.p1.y);
+    i64 x2 = SnapToSubpixel(t.p2.x);
+    i64 y2 = SnapToSubpixel(t.p2.y);
+    f32 i1 = t.i1;
+    f32 i2 = t.i2;
     
-    DrawFilledTriangle(x0, y0, z0, x1, y1, z1, x2, y2, z2, i0, i1, i2, c, canvas);
+    i64 area = EdgeFunctionFixed(x0, y0, x1, y1, x2, y2);
+    if(area == 0)
+        return false;
+    
+    if(area < 0)
+    {
+        Swap(x1, x2);
+        Swap(y1, y2);
+        Swap(i1, i2);
+        area = -area;
+    }
+    
+    f32 toPixels = 1.0f / SUBPIXEL_ONE;
+    f32 invArea = (f32)(SUBPIXEL_ONE * SUBPIXEL_ONE) / (f32)area;
+    plane = FixedIntensityPlane((f32)x0 * toPixels, (f32)y0 * toPixels, (f32)x1 * toPixels, (f32)y1 * toPixels,
+                                (f32)x2 * toPixels, (f32)y2 * toPixels, t.i0, i1, i2, invArea);
+    return true;
+}
+
+// NOTE(mevex): Same walk as RasterizeTriangleEdge on vertices snapped to 1/SUBPIXEL_ONE of a pixel.
+//              The edge functions are exact integers, so two triangles sharing an edge agree on
+//              every pixel center, and the top-left rule gives the centers right on the edge to
+//              only one of them: a mesh writes each pixel once, with no cracks. Depth and intensity
+//              are evaluated from the vertices at every pixel instead of being stepped, so they do
+//              not depend on where the clipping rectangle (the tile) starts.
+//              Triangles of a few blocks or more are walked block by block: the edge functions at the
+//              corners of a block tell whether it is outside, covered or partial, only the partial
+//              blocks test their pixels. Being exact, the result is the one of the plain walk.
+template <int depthFormat>
+u64 RasterizeTriangleFixed(p3 p0, p3 p1, p3 p2, f32 i0, f32 i1, f32 i2, Color c, Canvas &canvas,
+                           i32 clipMinX, i32 clipMinY, i32 clipMaxX, i32 clipMaxY, ThreadCounters *counters, u32 *ids, u32 id)
+{
+    i64 x0 = SnapToSubpixel(p0.x);
+    i64 y0 = SnapToSubpixel(p0.y);
+    i64 x1 = SnapToSubpixel(p1.x);
+    i64 y1 = SnapToSubpixel(p1.y);
+    i64 x2 = SnapToSubpixel(p2.x);
+    i64 y2 = SnapToSubpixel(p2.y);
+    
+    i64 area = EdgeFunctionFixed(x0, y0, x1, y1, x2, y2);
+    if(area == 0)
+        return 0;
+    
+    // NOTE(mevex): Make the winding counter-clockwise so that inside means all weights positive
+    if(area < 0)
+    {
+        Swap(x1, x2);
+        Swap(y1, y2);
+        Swap(p1, p2);
+        Swap(i1, i2);
+        area = -area;
+    }
+    
+    // NOTE(mevex): Pixel centers are at integer coordinates, the shifts round towards -infinity
+    i64 minXFixed = Min(x0, Min(x1, x2));
+    i64 maxXFixed = Max(x0, Max(x1, x2));
+    i64 minYFixed = Min(y0, Min(y1, y2));
+    i64 maxYFixed = Max(y0, Max(y1, y2));
+    i32 minX = Max((i32)((minXFixed + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS), clipMinX);
+    i32 maxX = Min((i32)(maxXFixed >> SUBPIXEL_BITS), clipMaxX);
+    i32 minY = Max((i32)((minYFixed + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS), clipMinY);
+    i32 maxY = Min((i32)(maxYFixed >> SUBPIXEL_BITS), clipMaxY);
+    if(minX > maxX || minY > maxY)
+        return 0;
+    
+    // NOTE(mevex): The centers on an edge that is not top-left must fail, so the bias makes them -1
+    FixedTriangle t;
+    t.originX = minX;
+    t.originY = minY;
+    i64 startX = (i64)minX << SUBPIXEL_BITS;
+    i64 startY = (i64)minY << SUBPIXEL_BITS;
+    t.w0 = EdgeFunctionFixed(x1, y1, x2, y2, startX, startY) - (IsTopLeftEdge(x1, y1, x2, y2) ? 0 : 1);
+    t.w1 = EdgeFunctionFixed(x2, y2, x0, y0, startX, startY) - (IsTopLeftEdge(x2, y2, x0, y0) ? 0 : 1);
+    t.w2 = EdgeFunctionFixed(x0, y0, x1, y1, startX, startY) - (IsTopLeftEdge(x0, y0, x1, y1) ? 0 : 1);
+    
+    t.w0dx = (y1 - y2) << SUBPIXEL_BITS;
+    t.w1dx = (y2 - y0) << SUBPIXEL_BITS;
+    t.w2dx = (y0 - y1) << SUBPIXEL_BITS;
+    t.w0dy = (x2 - x1) << SUBPIXEL_BITS;
+    t.w1dy = (x0 - x2) << SUBPIXEL_BITS;
+    t.w2dy = (x1 - x0) << SUBPIXEL_BITS;
+    
+    // NOTE(mevex): Planes of the reverse depth and of the intensity through the snapped vertices
+    f32 toPixels = 1.0f / SUBPIXEL_ONE;
+    f32 fx0 = (f32)x0 * toPixels;
+    f32 fy0 = (f32)y0 * toPixels;
+    f32 fx1 = (f32)x1 * toPixels;
+    f32 fy1 = (f32)y1 * toPixels;
+    f32 fx2 = (f32)x2 * toPixels;
+    f32 fy2 = (f32)y2 * toPixels;
+    f32 invArea = (f32)(SUBPIXEL_ONE * SUBPIXEL_ONE) / (f32)area;
+    
+    f32 z0 = 1.0f / p0.z;
+    f32 z1 = 1.0f / p1.z;
+    f32 z2 = 1.0f / p2.z;
+    t.x0 = fx0;
+    t.y0 = fy0;
+    t.z0 = z0;
+    t.zdx = ((fy1 - fy2)*z0 + (fy2 - fy0)*z1 + (fy0 - fy1)*z2) * invArea;
+    t.zdy = ((fx2 - fx1)*z0 + (fx0 - fx2)*z1 + (fx1 - fx0)*z2) * invArea;
+    IntensityPlane intensity = FixedIntensityPlane(fx0, fy0, fx1, fy1, fx2, fy2, i0, i1, i2, invArea);
+    t.i0 = intensity.i0;
+    t.idx = intensity.idx;
+    t.idy = intensity.idy;
+    
+    t.c = c;
+    t.ids = ids;
+    t.id = id;
+    t.pixelsTested = 0;
+    t.pixelsWritten = 0;
+    
+    // NOTE(mevex): Below two blocks on a side there are too few covered blocks to pay for sorting them
+    if(maxX - minX < 2*RASTER_BLOCK_SIZE || maxY - minY < 2*RASTER_BLOCK_SIZE)
+    {
+        RasterizeFixedRect<depthFormat>(t, canvas, minX, minY, maxX, maxY, counters);
+    }
+    else
+    {
+        // NOTE(mevex): The blocks are aligned to the canvas and cut to the bounding box. The edge
+        //              functions are affine, so their least value in a block is at one of its corners.
+        //              Partial blocks next to each other in a row are walked together, from runLeft.
+        for(i32 blockY = minY & ~(RASTER_BLOCK_SIZE - 1); blockY <= maxY; blockY += RASTER_BLOCK_SIZE)
+        {
+            i32 bottom = Max(blockY, minY);
+            i32 top = Min(blockY + RASTER_BLOCK_SIZE - 1, maxY);
+            i32 runLeft = -1;
+            for(i32 blockX = minX & ~(RASTER_BLOCK_SIZE - 1); blockX <= maxX; blockX += RASTER_BLOCK_SIZE)
+            {
+                i32 left = Max(blockX, minX);
+                i32 right = Min(blockX + RASTER_BLOCK_SIZE - 1, maxX);
+                
+                i64 a0, a1, a2, b0, b1, b2, c0, c1, c2, d0, d1, d2;
+                FixedEdgesAt(t, left, bottom, a0, a1, a2);
+                FixedEdgesAt(t, right, bottom, b0, b1, b2);
+                FixedEdgesAt(t, left, top, c0, c1, c2);
+                FixedEdgesAt(t, right, top, d0, d1, d2);
+                
+                // NOTE(mevex): Outside when all the corners are behind the same edge
+                bool outside = (a0 & b0 & c0 & d0) < 0 || (a1 & b1 & c1 & d1) < 0 || (a2 & b2 & c2 & d2) < 0;
+                bool covered = (a0 | b0 | c0 | d0 | a1 | b1 | c1 | d1 | a2 | b2 | c2 | d2) >= 0;
+                if(!outside && !covered)
+                {
+                    if(runLeft < 0)
+                        runLeft = left;
+                    continue;
+                }
+                
+                if(runLeft >= 0)
+                {
+                    RasterizeFixedRect<depthFormat>(t, canvas, runLeft, bottom, left - 1, top, counters);
+                    runLeft = -1;
+                }
+                if(covered)
+                    FillFixedRect<depthFormat>(t, canvas, left, bottom, right, top, counters);
+            }
+            
+            if(runLeft >= 0)
+                RasterizeFixedRect<depthFormat>(t, canvas, runLeft, bottom, maxX, top, counters);
+        }
+    }
+    
+    CountStat(counters, COUNTER_PIXELS_TESTED, t.pixelsTested);
+    CountStat(counters, COUNTER_PIXELS_DEPTH_REJECTED, t.pixelsTested - t.pixelsWritten);
+    CountStat(counters, COUNTER_PIXELS_WRITTEN, t.pixelsWritten);
+    if(!ids)
+        CountStat(counters, COUNTER_PIXELS_SHADED, t.pixelsWritten);
+    
+    return t.pixelsWritten;
+}
+
+u64 DrawFilledTriangleFixed(p3 p0, p3 p1, p3 p2, f32 i0, f32 i1, f32 i2, Color c, Canvas &canvas,
+                            i32 clipMinX, i32 clipMinY, i32 clipMaxX, i32 clipMaxY,
+                            ThreadCounters *counters = NULL, u32 *ids = NULL, u32 id = 0)
+{
+    switch(canvas.depthFormat)
+    {
+        case DEPTH_FORMAT_UNORM16:
+            return RasterizeTriangleFixed<DEPTH_FORMAT_UNORM16>(p0, p1, p2, i0, i1, i2, c, canvas, clipMinX, clipMinY, clipMaxX, clipMaxY, counters, ids, id);
+        case DEPTH_FORMAT_UNORM24:
+            return RasterizeTriangleFixed<DEPTH_FORMAT_UNORM24>(p0, p1, p2, i0, i1, i2, c, canvas, clipMinX, clipMinY, clipMaxX, clipMaxY, counters, ids, id);
+        default:
+            return RasterizeTriangleFixed<DEPTH_FORMAT_FLOAT32>(p0, p1, p2, i0, i1, i2, c, canvas, clipMinX, clipMinY, clipMaxX, clipMaxY, counters, ids, id);
+    }
+}
+
+inline u64 DrawFilledTriangleFixed(p3 p0, p3 p1, p3 p2, f32 i0, f32 i1, f32 i2, Color c, Canvas &canvas,
+                                   ThreadCounters *counters = NULL, u32 *ids = NULL, u32 id = 0)
+{
+    return DrawFilledTriangleFixed(p0, p1, p2, i0, i1, i2, c, canvas, 0, 0, canvas.width - 1, canvas.height - 1, counters, ids, id);
 }
 
 inline void DrawWireframeTriangle(p3 p0, p3 p1, p3 p2, Color c, Canvas &canvas)
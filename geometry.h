@@ -0,0 +1,165 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include "simd.h"
+
+inline VertexStreams PushVertexStreams(MemoryArena &arena, size_t capacity)
+{
+    VertexStreams result = {};
+    result.x = arena.PushArray<f32>(capacity);
+    result.y = arena.PushArray<f32>(capacity);
+    result.z = arena.PushArray<f32>(capacity);
+    result.capacity = capacity;
+    return result;
+}
+
+// NOTE(mevex): What is needed to work on a mesh in its own space instead of camera space.
+//              With r0, r1, r2 the rows of the 3x3 part of m, the rows of its inverse transpose
+//              are r1xr2, r2xr0 and r0xr1 over the determinant. That is the matrix that takes
+//              object space normals to camera space ones.
+struct ObjectSpaceView
+{
+    v3 inverseTranspose[3];
+    f32 determinant;
+    p3 eye; // NOTE(mevex): The camera position, where m sends the origin of camera space
+};
+
+ObjectSpaceView GetObjectSpaceView(m4x4 &m)
+{
+    v3 r0 = v3(m.e[0][0], m.e[0][1], m.e[0][2]);
+    v3 r1 = v3(m.e[1][0], m.e[1][1], m.e[1][2]);
+    v3 r2 = v3(m.e[2][0], m.e[2][1], m.e[2][2]);
+    
+    ObjectSpaceView result;
+    v3 cofactor0 = Cross(r1, r2);
+    result.determinant = Dot(r0, cofactor0);
+    f32 invDeterminant = 1.0f / result.determinant;
+    result.inverseTranspose[0] = invDeterminant * cofactor0;
+    result.inverseTranspose[1] = invDeterminant * Cross(r2, r0);
+    result.inverseTranspose[2] = invDeterminant * Cross(r0, r1);
+    
+    // NOTE(mevex): eye = -inverse(m3x3) * translation, the columns of the inverse are the rows computed above
+    for(int i = 0; i < 3; ++i)
+    {
+        result.eye.e[i] = -(result.inverseTranspose[0].e[i]*m.e[0][3] +
+                            result.inverseTranspose[1].e[i]*m.e[1][3] +
+                            result.inverseTranspose[2].e[i]*m.e[2][3]);
+    }
+    return result;
+}
+
+inline v3 CameraSpaceNormal(ObjectSpaceView &view, v3 n)
+{
+    v3 result = v3(Dot(view.inverseTranspose[0], n), Dot(view.inverseTranspose[1], n), Dot(view.inverseTranspose[2], n));
+    return result;
+}
+
+// NOTE(mevex): Batched version of NotHomogeneous(m * HomogeneousPoint(p)) over a whole vertex array.
+//              The sums are done in the same order as operator *(m4x4, v4) so the results match.
+//              out must have room for all the vertices of in, it can be in itself.
+void TransformVertices(m4x4 &m, VertexStreams &in, VertexStreams &out)
+{
+    size_t count = in.count;
+    Assert(out.capacity >= count);
+    out.count = count;
+    
+    f32 *inX = in.x;
+    f32 *inY = in.y;
+    f32 *inZ = in.z;
+    f32 *outX = out.x;
+    f32 *outY = out.y;
+    f32 *outZ = out.z;
+    
+    lane_f32 m00 = LaneSet1(m.e[0][0]);
+    lane_f32 m01 = LaneSet1(m.e[0][1]);
+    lane_f32 m02 = LaneSet1(m.e[0][2]);
+    lane_f32 m03 = LaneSet1(m.e[0][3]);
+    lane_f32 m10 = LaneSet1(m.e[1][0]);
+    lane_f32 m11 = LaneSet1(m.e[1][1]);
+    lane_f32 m12 = LaneSet1(m.e[1][2]);
+    lane_f32 m13 = LaneSet1(m.e[1][3]);
+    lane_f32 m20 = LaneSet1(m.e[2][0]);
+    lane_f32 m21 = LaneSet1(m.e[2][1]);
+    lane_f32 m22 = LaneSet1(m.e[2][2]);
+    lane_f32 m23 = LaneSet1(m.e[2][3]);
+    
+    size_t i = 0;
+    for(; i + LANE_WIDTH <= count; i += LANE_WIDTH)
+    {
+        lane_f32 x = LaneLoad(inX + i);
+        lane_f32 y = LaneLoad(inY + i);
+        lane_f32 z = LaneLoad(inZ + i);
+        
+        lane_f32 rx = LaneAdd(LaneAdd(LaneAdd(LaneMul(m00, x), LaneMul(m01, y)), LaneMul(m02, z)), m03);
+        lane_f32 ry = LaneAdd(LaneAdd(LaneAdd(LaneMul(m10, x), LaneMul(m11, y)), LaneMul(m12, z)), m13);
+        lane_f32 rz = LaneAdd(LaneAdd(LaneAdd(LaneMul(m20, x), LaneMul(m21, y)), LaneMul(m22, z)), m23);
+        
+        LaneStore(outX + i, rx);
+        LaneStore(outY + i, ry);
+        LaneStore(outZ + i, rz);
+    }
+    
+    // NOTE(mevex): Leftover vertices that do not fill a whole register
+    for(; i < count; ++i)
+    {
+        f32 x = inX[i];
+        f32 y = inY[i];
+        f32 z = inZ[i];
+        outX[i] = m.e[0][0]*x + m.e[0][1]*y + m.e[0][2]*z + m.e[0][3];
+        outY[i] = m.e[1][0]*x + m.e[1][1]*y + m.e[1][2]*z + m.e[1][3];
+        outZ[i] = m.e[2][0]*x + m.e[2][1]*y + m.e[2][2]*z + m.e[2][3];
+    }
+}
+
+// NOTE(mevex): Batched version of Camera::Project. The two divides are folded into a
+//              single reciprocal of the depth and the viewport to canvas scale is precomputed.
+void ProjectVertices(Camera &cam, VertexStreams &in, VertexStreams &out)
+{
+    size_t count = in.count;
+    Assert(out.capacity >= count);
+    out.count = count;
+    
+    f32 *inX = in.x;
+    f32 *inY = in.y;
+    f32 *inZ = in.z;
+    f32 *outX = out.x;
+    f32 *outY = out.y;
+    f32 *outZ = out.z;
+    
+    f32 scaleX = cam.canvas.width / cam.vpWidth;
+    f32 scaleY = cam.canvas.height / cam.vpHeight;
+    f32 halfWidth = 0.5f * cam.canvas.width;
+    f32 halfHeight = 0.5f * cam.canvas.height;
+    
+    lane_f32 wideScaleX = LaneSet1(scaleX);
+    lane_f32 wideScaleY = LaneSet1(scaleY);
+    lane_f32 wideHalfWidth = LaneSet1(halfWidth);
+    lane_f32 wideHalfHeight = LaneSet1(halfHeight);
+    lane_f32 zero = LaneSet1(0.0f);
+    lane_f32 one = LaneSet1(1.0f);
+    
+    size_t i = 0;
+    for(; i + LANE_WIDTH <= count; i += LANE_WIDTH)
+    {
+        lane_f32 depth = LaneSub(zero, LaneLoad(inZ + i));
+        lane_f32 invDepth = LaneDiv(one, depth);
+        
+        lane_f32 cx = LaneAdd(LaneMul(LaneMul(LaneLoad(inX + i), invDepth), wideScaleX), wideHalfWidth);
+        lane_f32 cy = LaneAdd(LaneMul(LaneMul(LaneLoad(inY + i), invDepth), wideScaleY), wideHalfHeight);
+        
+        LaneStore(outX + i, cx);
+        LaneStore(outY + i, cy);
+        LaneStore(outZ + i, depth);
+    }
+    
+    for(; i < count; ++i)
+    {
+        f32 depth = -inZ[i];
+        f32 invDepth = 1.0f / depth;
+        outX[i] = inX[i]*invDepth*scaleX + halfWidth;
+        outY[i] = inY[i]*invDepth*scaleY + halfHeight;
+        outZ[i] = depth;
+    }
+}
+
+#endif //GEOMETRY_H
@@ -0,0 +1,875 @@
+#ifndef IMAGEENCODER_H
+#define IMAGEENCODER_H
+
+// NOTE(mevex): Image output. The canvas is 8 bit RGBA in memory (AABBGGRR read as a u32) and in the
+//              linear layout the rows are top down, which is already what every format here wants,
+//              so the encoders read it in place. A tiled canvas is detiled into a buffer first.
+//              - PNG: the rows are split into bands that are filtered and deflated in parallel. Every
+//                band is an independent deflate stream ending with an empty stored block, that leaves
+//                it byte aligned so the bands are simply concatenated into the one zlib stream of the
+//                file. The deflate only uses the fixed Huffman codes, like stb_image_write.
+//              - STB_PNG: stbi_write_png, single threaded, kept to compare against
+//              - QOI: single pass, much faster than deflate and still a fair size
+//              - PAM: the canvas memory written as is, RGBA needs no conversion in this format
+//              - PPM: RGB, converted one row at a time
+//              - Y4M: YUV 4:4:4 video, every image written with the same filename is appended as
+//                a new frame of the same stream
+
+#include <string>
+
+enum image_format
+{
+    IMAGE_FORMAT_PNG,
+    IMAGE_FORMAT_STB_PNG,
+    IMAGE_FORMAT_QOI,
+    IMAGE_FORMAT_PAM,
+    IMAGE_FORMAT_PPM,
+    IMAGE_FORMAT_Y4M,
+    
+    IMAGE_FORMATS_COUNT
+};
+
+global_variable const char *imageFormatNames[IMAGE_FORMATS_COUNT] = {"png", "stbpng", "qoi", "pam", "ppm", "y4m"};
+
+struct ImageSettings
+{
+    int format = IMAGE_FORMAT_PNG;
+    
+    // NOTE(mevex): PNG only, 0 stores the rows uncompressed and 9 searches the longest matches
+    int compressionLevel = 6;
+    
+    // NOTE(mevex): Y4M only, written in the header of the stream
+    int frameRate = 24;
+};
+
+#define PNG_BAND_ROWS 32
+
+// NOTE(mevex): Tables for the crc of 4 bytes at a time (slicing by 4). The first one is the usual
+//              byte at a time table, the others advance a byte through 1, 2 and 3 more zero bytes.
+struct CrcTables
+{
+    u32 t[4][256];
+    
+    CrcTables()
+    {
+        for(u32 n = 0; n < 256; ++n)
+        {
+            u32 c = n;
+            for(int k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[0][n] = c;
+        }
+        for(u32 n = 0; n < 256; ++n)
+        {
+            for(int k = 1; k < 4; ++k)
+                t[k][n] = (t[k - 1][n] >> 8) ^ t[0][t[k - 1][n] & 0xFF];
+        }
+    }
+};
+
+inline u32 Crc32(u32 crc, u8 *data, size_t size)
+{
+    // NOTE(mevex): Built on the first call, the initialization of a local static is thread safe
+    static CrcTables tables;
+    
+    crc = ~crc;
+    size_t i = 0;
+    for(; i + 4 <= size; i += 4)
+    {
+        u32 word;
+        memcpy(&word, data + i, 4);
+        crc ^= word;
+        crc = tables.t[3][crc & 0xFF] ^ tables.t[2][(crc >> 8) & 0xFF] ^ tables.t[1][(crc >> 16) & 0xFF] ^ tables.t[0][crc >> 24];
+    }
+    for(; i < size; ++i)
+        crc = tables.t[0][(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+#define ADLER_MOD 65521
+
+inline u32 Adler32(u8 *data, size_t size)
+{
+    u32 a = 1;
+    u32 b = 0;
+    while(size)
+    {
+        // NOTE(mevex): 5552 bytes is the most that can be summed before b overflows 32 bits
+        size_t n = Min(size, (size_t)5552);
+        for(size_t i = 0; i < n; ++i)
+        {
+            a += data[i];
+            b += a;
+        }
+        a %= ADLER_MOD;
+        b %= ADLER_MOD;
+        data += n;
+        size -= n;
+    }
+    return (b << 16) | a;
+}
+
+// NOTE(mevex): Checksum of two buffers one after the other from the checksums of each one
+inline u32 Adler32Combine(u32 first, u32 second, size_t secondSize)
+{
+    u32 remainder = (u32)(secondSize % ADLER_MOD);
+    u32 a1 = first & 0xFFFF;
+    u32 b1 = first >> 16;
+    u32 a2 = second & 0xFFFF;
+    u32 b2 = second >> 16;
+    
+    u32 a = (a1 + a2 + ADLER_MOD - 1) % ADLER_MOD;
+    u32 b = (u32)(((u64)remainder * a1 + b1 + b2 + ADLER_MOD - remainder) % ADLER_MOD);
+    return (b << 16) | a;
+}
+
+// NOTE(mevex): Deflate packs the bits starting from the least significant one
+struct BitWriter
+{
+    vector<u8> &out;
+    u32 bits;
+    int count;
+    
+    BitWriter(vector<u8> &o) : out(o), bits(0), count(0) {}
+    
+    inline void Put(u32 value, int n)
+    {
+        bits |= value << count;
+        count += n;
+        while(count >= 8)
+        {
+            out.push_back((u8)bits);
+            bits >>= 8;
+            count -= 8;
+        }
+    }
+    
+    inline void Align()
+    {
+        if(count)
+            Put(0, 8 - count);
+    }
+};
+
+global_variable u16 deflateLengthBase[29] = {3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258};
+global_variable u8 deflateLengthExtra[29] = {0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0};
+global_variable u16 deflateDistanceBase[30] = {1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577};
+global_variable u8 deflateDistanceExtra[30] = {0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
+
+// NOTE(mevex): Longest hash chain walked for every position, by compression level
+global_variable int deflateChainLimits[10] = {0, 1, 4, 8, 16, 32, 64, 128, 256, 1024};
+
+#define DEFLATE_WINDOW_SIZE 32768
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+#define DEFLATE_HASH_BITS 15
+
+// NOTE(mevex): Huffman codes go into the stream the other way around, most significant bit first,
+//              so the fixed codes are kept already reversed
+inline u32 ReverseBits(u32 code, int n)
+{
+    u32 result = 0;
+    for(int i = 0; i < n; ++i)
+        result |= ((code >> i) & 1) << (n - 1 - i);
+    return result;
+}
+
+struct FixedHuffmanCodes
+{
+    u16 literals[288];
+    u8 literalLengths[288];
+    u8 distances[30];
+    
+    FixedHuffmanCodes()
+    {
+        for(int symbol = 0; symbol < 288; ++symbol)
+        {
+            if(symbol <= 143)
+            {
+                literals[symbol] = (u16)ReverseBits(0x30 + symbol, 8);
+                literalLengths[symbol] = 8;
+            }
+            else if(symbol <= 255)
+            {
+                literals[symbol] = (u16)ReverseBits(0x190 + (symbol - 144), 9);
+                literalLengths[symbol] = 9;
+            }
+            else if(symbol <= 279)
+            {
+                literals[symbol] = (u16)ReverseBits(symbol - 256, 7);
+                literalLengths[symbol] = 7;
+            }
+            else
+            {
+                literals[symbol] = (u16)ReverseBits(0xC0 + (symbol - 280), 8);
+                literalLengths[symbol] = 8;
+            }
+        }
+        for(int d = 0; d < 30; ++d)
+            distances[d] = (u8)ReverseBits(d, 5);
+    }
+};
+
+inline void PutFixedLiteral(BitWriter &writer, FixedHuffmanCodes &codes, int symbol)
+{
+    writer.Put(codes.literals[symbol], codes.literalLengths[symbol]);
+}
+
+inline void PutFixedMatch(BitWriter &writer, FixedHuffmanCodes &codes, int length, int distance)
+{
+    int l = 28;
+    while(deflateLengthBase[l] > length)
+        --l;
+    PutFixedLiteral(writer, codes, 257 + l);
+    writer.Put(length - deflateLengthBase[l], deflateLengthExtra[l]);
+    
+    int d = 29;
+    while(deflateDistanceBase[d] > distance)
+        --d;
+    writer.Put(codes.distances[d], 5);
+    writer.Put(distance - deflateDistanceBase[d], deflateDistanceExtra[d]);
+}
+
+inline u32 DeflateHash(u8 *at)
+{
+    u32 key = (u32)at[0] | (u32)at[1] << 8 | (u32)at[2] << 16;
+    return (key * 2654435761u) >> (32 - DEFLATE_HASH_BITS);
+}
+
+// NOTE(mevex): Raw deflate of one band, with no zlib header. When it is not the last band it ends
+//              with an empty stored block (a sync flush) so that the next band starts on a byte.
+//              Matches do not cross into the previous band, that costs a little of compression.
+void DeflateBand(u8 *data, size_t size, int level, bool last, vector<u8> &out)
+{
+    BitWriter writer(out);
+    
+    if(level <= 0)
+    {
+        // NOTE(mevex): Stored blocks, at most 65535 bytes each
+        size_t done = 0;
+        do
+        {
+            size_t remaining = size - done;
+            u32 blockSize = (u32)(Min(remaining, (size_t)65535));
+            bool lastBlock = last && (done + blockSize == size);
+            writer.Put(lastBlock ? 1 : 0, 1);
+            writer.Put(0, 2);
+            writer.Align();
+            out.push_back((u8)blockSize);
+            out.push_back((u8)(blockSize >> 8));
+            out.push_back((u8)~blockSize);
+            out.push_back((u8)(~blockSize >> 8));
+            out.insert(out.end(), data + done, data + done + blockSize);
+            done += blockSize;
+        } while(done < size);
+        return;
+    }
+    
+    static FixedHuffmanCodes codes;
+    int chainLimit = deflateChainLimits[Min(level, 9)];
+    vector<i32> head(1 << DEFLATE_HASH_BITS, -1);
+    vector<i32> previous(size);
+    
+    writer.Put(last ? 1 : 0, 1);
+    writer.Put(1, 2);
+    
+    size_t i = 0;
+    while(i < size)
+    {
+        int bestLength = 0;
+        int bestDistance = 0;
+        if(i + DEFLATE_MIN_MATCH <= size)
+        {
+            u32 hash = DeflateHash(data + i);
+            size_t remaining = size - i;
+            int maxLength = (int)(Min(remaining, (size_t)DEFLATE_MAX_MATCH));
+            i32 candidate = head[hash];
+            for(int chain = 0; chain < chainLimit && candidate >= 0 && i - candidate <= DEFLATE_WINDOW_SIZE; ++chain)
+            {
+                u8 *a = data + candidate;
+                u8 *b = data + i;
+                int length = 0;
+                while(length < maxLength && a[length] == b[length])
+                    ++length;
+                
+                if(length > bestLength)
+                {
+                    bestLength = length;
+                    bestDistance = (int)(i - candidate);
+                    if(length == maxLength)
+                        break;
+                }
+                candidate = previous[candidate];
+            }
+        }
+        
+        size_t advance = 1;
+        if(bestLength >= DEFLATE_MIN_MATCH)
+        {
+            PutFixedMatch(writer, codes, bestLength, bestDistance);
+            advance = bestLength;
+        }
+        else
+        {
+            PutFixedLiteral(writer, codes, data[i]);
+        }
+        
+        // NOTE(mevex): Every position covered is hashed, so later matches can start inside this one
+        for(size_t end = i + advance; i < end; ++i)
+        {
+            if(i + DEFLATE_MIN_MATCH <= size)
+            {
+                u32 hash = DeflateHash(data + i);
+                previous[i] = head[hash];
+                head[hash] = (i32)i;
+            }
+        }
+    }
+    
+    PutFixedLiteral(writer, codes, 256);
+    if(!last)
+    {
+        writer.Put(0, 1);
+        writer.Put(0, 2);
+        writer.Align();
+        out.push_back(0x00);
+        out.push_back(0x00);
+        out.push_back(0xFF);
+        out.push_back(0xFF);
+    }
+    writer.Align();
+}
+
+enum png_filter
+{
+    PNG_FILTER_NONE,
+    PNG_FILTER_SUB,
+    PNG_FILTER_UP,
+    PNG_FILTER_AVERAGE,
+    PNG_FILTER_PAETH,
+    
+    PNG_FILTERS_COUNT
+};
+
+inline u8 PaethPredictor(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a);
+    int pb = abs(p - b);
+    int pc = abs(p - c);
+    if(pa <= pb && pa <= pc)
+        return (u8)a;
+    if(pb <= pc)
+        return (u8)b;
+    return (u8)c;
+}
+
+// NOTE(mevex): The pixels left of the row are zero, so the first pixel of Sub is the pixel itself
+//              and the first pixel of Paeth predicts from above. above is never NULL, the first row
+//              of the image gets a row of zeros.
+void ApplyPngFilter(int filter, u8 *row, u8 *above, int rowSize, u8 *out)
+{
+    const int bpp = 4;
+    switch(filter)
+    {
+        case PNG_FILTER_NONE:
+        {
+            memcpy(out, row, rowSize);
+        } break;
+        
+        case PNG_FILTER_SUB:
+        {
+            for(int i = 0; i < bpp; ++i)
+                out[i] = row[i];
+            for(int i = bpp; i < rowSize; ++i)
+                out[i] = (u8)(row[i] - row[i - bpp]);
+        } break;
+        
+        case PNG_FILTER_UP:
+        {
+            for(int i = 0; i < rowSize; ++i)
+                out[i] = (u8)(row[i] - above[i]);
+        } break;
+        
+        case PNG_FILTER_AVERAGE:
+        {
+            for(int i = 0; i < bpp; ++i)
+                out[i] = (u8)(row[i] - (above[i] >> 1));
+            for(int i = bpp; i < rowSize; ++i)
+                out[i] = (u8)(row[i] - ((row[i - bpp] + above[i]) >> 1));
+        } break;
+        
+        case PNG_FILTER_PAETH:
+        {
+            for(int i = 0; i < bpp; ++i)
+                out[i] = (u8)(row[i] - above[i]);
+            for(int i = bpp; i < rowSize; ++i)
+                out[i] = (u8)(row[i] - PaethPredictor(row[i - bpp], above[i], above[i - bpp]));
+        } break;
+    }
+}
+
+// NOTE(mevex): Sum of the residuals read as signed bytes, small means it deflates well
+inline u32 PngFilterScore(u8 *residuals, int size)
+{
+    u32 result = 0;
+    for(int i = 0; i < size; ++i)
+    {
+        u32 v = residuals[i];
+        result += v < 128 ? v : 256 - v;
+    }
+    return result;
+}
+
+// NOTE(mevex): Writes the filter type byte and the filtered row. With adaptive set every filter is
+//              tried and the one with the smallest score is kept, like libpng does. scratch must
+//              hold a row.
+void FilterPngRow(u8 *row, u8 *above, int rowSize, bool adaptive, u8 *out, u8 *scratch)
+{
+    out[0] = PNG_FILTER_NONE;
+    ApplyPngFilter(PNG_FILTER_NONE, row, above, rowSize, out + 1);
+    if(!adaptive)
+        return;
+    
+    u32 bestScore = PngFilterScore(out + 1, rowSize);
+    for(int filter = PNG_FILTER_SUB; filter < PNG_FILTERS_COUNT; ++filter)
+    {
+        ApplyPngFilter(filter, row, above, rowSize, scratch);
+        u32 score = PngFilterScore(scratch, rowSize);
+        if(score < bestScore)
+        {
+            bestScore = score;
+            out[0] = (u8)filter;
+            memcpy(out + 1, scratch, rowSize);
+        }
+    }
+}
+
+struct PngBand
+{
+    vector<u8> filtered;
+    vector<u8> compressed;
+    u32 adler;
+};
+
+struct PngEncodeJob
+{
+    u8 *pixels;
+    i32 width;
+    i32 height;
+    int level;
+    int bandsCount;
+    PngBand *bands;
+    std::atomic<int> nextBand;
+};
+
+shared_function void EncodePngWork(void *data, int workerIndex)
+{
+    PngEncodeJob *job = (PngEncodeJob *)data;
+    int rowSize = job->width * 4;
+    
+    while(true)
+    {
+        int bandIndex = job->nextBand.fetch_add(1, std::memory_order_relaxed);
+        if(bandIndex >= job->bandsCount)
+            break;
+        
+        TIMED_ZONE("EncodePngBand");
+        PngBand &band = job->bands[bandIndex];
+        int firstRow = bandIndex * PNG_BAND_ROWS;
+        int rowsCount = Min(PNG_BAND_ROWS, job->height - firstRow);
+        
+        band.filtered.resize((size_t)rowsCount * (rowSize + 1));
+        vector<u8> scratch(rowSize);
+        vector<u8> zeroRow;
+        for(int r = 0; r < rowsCount; ++r)
+        {
+            int y = firstRow + r;
+            u8 *row = job->pixels + (size_t)y * rowSize;
+            u8 *above = row - rowSize;
+            if(y == 0)
+            {
+                zeroRow.resize(rowSize, 0);
+                above = zeroRow.data();
+            }
+            FilterPngRow(row, above, rowSize, job->level > 0, band.filtered.data() + (size_t)r * (rowSize + 1), scratch.data());
+        }
+        
+        band.adler = Adler32(band.filtered.data(), band.filtered.size());
+        band.compressed.clear();
+        DeflateBand(band.filtered.data(), band.filtered.size(), job->level, bandIndex == job->bandsCount - 1, band.compressed);
+    }
+}
+
+inline void PushU32BigEndian(vector<u8> &out, u32 value)
+{
+    out.push_back((u8)(value >> 24));
+    out.push_back((u8)(value >> 16));
+    out.push_back((u8)(value >> 8));
+    out.push_back((u8)value);
+}
+
+// NOTE(mevex): Writes a whole PNG chunk, the crc covers the type and the data
+inline void PushPngChunk(vector<u8> &out, const char *type, u8 *data, size_t size)
+{
+    PushU32BigEndian(out, (u32)size);
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    if(size)
+        out.insert(out.end(), data, data + size);
+    PushU32BigEndian(out, Crc32(0, out.data() + start, size + 4));
+}
+
+// NOTE(mevex): pool can be NULL, then the bands are encoded on this thread
+// NOTE(mevex): pixels are RGBA, the rows top down
+void EncodePng(u8 *pixels, i32 width, i32 height, int level, WorkerPool *pool, vector<u8> &out)
+{
+    TIMED_FUNCTION();
+    
+    PngEncodeJob job;
+    job.pixels = pixels;
+    job.width = width;
+    job.height = height;
+    job.level = level;
+    job.bandsCount = (height + PNG_BAND_ROWS - 1) / PNG_BAND_ROWS;
+    vector<PngBand> bands(job.bandsCount);
+    job.bands = bands.data();
+    job.nextBand = 0;
+    
+    if(pool)
+        pool->Run(EncodePngWork, &job);
+    else
+        EncodePngWork(&job, 0);
+    
+    // NOTE(mevex): One zlib stream: header, the bands in order, adler32 of all the filtered rows
+    vector<u8> zlib;
+    size_t compressedSize = 2 + 4;
+    for(PngBand &band : bands)
+        compressedSize += band.compressed.size();
+    zlib.reserve(compressedSize);
+    
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+    u32 adler = 1;
+    for(PngBand &band : bands)
+    {
+        zlib.insert(zlib.end(), band.compressed.begin(), band.compressed.end());
+        adler = Adler32Combine(adler, band.adler, band.filtered.size());
+    }
+    PushU32BigEndian(zlib, adler);
+    
+    u8 header[13];
+    header[0] = (u8)(width >> 24);
+    header[1] = (u8)(width >> 16);
+    header[2] = (u8)(width >> 8);
+    header[3] = (u8)width;
+    header[4] = (u8)(height >> 24);
+    header[5] = (u8)(height >> 16);
+    header[6] = (u8)(height >> 8);
+    header[7] = (u8)height;
+    header[8] = 8; // bits per channel
+    header[9] = 6; // RGBA
+    header[10] = 0;
+    header[11] = 0;
+    header[12] = 0;
+    
+    u8 signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    out.clear();
+    out.insert(out.end(), signature, signature + 8);
+    PushPngChunk(out, "IHDR", header, sizeof(header));
+    PushPngChunk(out, "IDAT", zlib.data(), zlib.size());
+    PushPngChunk(out, "IEND", NULL, 0);
+}
+
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF 0x40
+#define QOI_OP_LUMA 0x80
+#define QOI_OP_RUN 0xC0
+#define QOI_OP_RGB 0xFE
+#define QOI_OP_RGBA 0xFF
+
+// NOTE(mevex): The Quite OK Image format, see qoiformat.org
+void EncodeQoi(u8 *pixels, i32 width, i32 height, vector<u8> &out)
+{
+    TIMED_FUNCTION();
+    
+    out.clear();
+    out.reserve((size_t)width * height * 5 + 22);
+    const char magic[4] = {'q', 'o', 'i', 'f'};
+    out.insert(out.end(), magic, magic + 4);
+    PushU32BigEndian(out, (u32)width);
+    PushU32BigEndian(out, (u32)height);
+    out.push_back(4); // RGBA
+    out.push_back(0); // sRGB with linear alpha
+    
+    u8 index[64][4] = {};
+    u8 previous[4] = {0, 0, 0, 255};
+    int run = 0;
+    
+    u8 *pixel = pixels;
+    size_t pixelsCount = (size_t)width * height;
+    for(size_t p = 0; p < pixelsCount; ++p, pixel += 4)
+    {
+        if(*(u32 *)pixel == *(u32 *)previous)
+        {
+            ++run;
+            if(run == 62 || p == pixelsCount - 1)
+            {
+                out.push_back((u8)(QOI_OP_RUN | (run - 1)));
+                run = 0;
+            }
+            continue;
+        }
+        
+        if(run > 0)
+        {
+            out.push_back((u8)(QOI_OP_RUN | (run - 1)));
+            run = 0;
+        }
+        
+        int hash = (pixel[0]*3 + pixel[1]*5 + pixel[2]*7 + pixel[3]*11) % 64;
+        if(*(u32 *)index[hash] == *(u32 *)pixel)
+        {
+            out.push_back((u8)(QOI_OP_INDEX | hash));
+        }
+        else
+        {
+            memcpy(index[hash], pixel, 4);
+            if(pixel[3] == previous[3])
+            {
+                i8 dr = (i8)(pixel[0] - previous[0]);
+                i8 dg = (i8)(pixel[1] - previous[1]);
+                i8 db = (i8)(pixel[2] - previous[2]);
+                i8 drg = (i8)(dr - dg);
+                i8 dbg = (i8)(db - dg);
+                
+                if(dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+                {
+                    out.push_back((u8)(QOI_OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+                }
+                else if(dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7)
+                {
+                    out.push_back((u8)(QOI_OP_LUMA | (dg + 32)));
+                    out.push_back((u8)((drg + 8) << 4 | (dbg + 8)));
+                }
+                else
+                {
+                    out.push_back(QOI_OP_RGB);
+                    out.insert(out.end(), pixel, pixel + 3);
+                }
+            }
+            else
+            {
+                out.push_back(QOI_OP_RGBA);
+                out.insert(out.end(), pixel, pixel + 4);
+            }
+        }
+        memcpy(previous, pixel, 4);
+    }
+    
+    u8 padding[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+    out.insert(out.end(), padding, padding + 8);
+}
+
+// NOTE(mevex): Encodes and writes the images of one thread. It keeps its buffers between the
+//              images and the Y4M stream open until an image with another filename comes.
+class ImageEncoder
+{
+    public:
+    
+    WorkerPool *pool;
+    vector<u8> encoded;
+    vector<u8> planes;
+    vector<u32> detiled;
+    
+    FILE *video;
+    std::string videoFilename;
+    
+    ImageEncoder(WorkerPool *p = NULL)
+    {
+        pool = p;
+        video = NULL;
+    }
+    
+    ~ImageEncoder()
+    {
+        CloseVideo();
+    }
+    
+    bool CloseVideo()
+    {
+        bool result = true;
+        if(video)
+            result = fclose(video) == 0;
+        video = NULL;
+        videoFilename.clear();
+        return result;
+    }
+    
+    bool WriteEncoded(const char *filename)
+    {
+        FILE *file = OpenFile(filename, "wb");
+        if(!file)
+            return false;
+        
+        bool result = fwrite(encoded.data(), 1, encoded.size(), file) == encoded.size();
+        result = (fclose(file) == 0) && result;
+        return result;
+    }
+    
+    // NOTE(mevex): The pixels of the canvas in the linear layout, copied only when it is tiled
+    u8 *LinearPixels(Canvas &canvas)
+    {
+        Assert(canvas.bytesPerPixel == 4);
+        if(canvas.layout.type == CANVAS_LAYOUT_LINEAR)
+            return (u8 *)canvas.memory;
+        
+        TIMED_ZONE("Detile");
+        detiled.resize((size_t)canvas.width * canvas.height);
+        canvas.Detile(detiled.data());
+        return (u8 *)detiled.data();
+    }
+    
+    bool WritePam(Canvas &canvas, const char *filename)
+    {
+        FILE *file = OpenFile(filename, "wb");
+        if(!file)
+            return false;
+        
+        fprintf(file, "P7\nWIDTH %d\nHEIGHT %d\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n", canvas.width, canvas.height);
+        size_t size = (size_t)canvas.width * canvas.height * 4;
+        bool result = fwrite(LinearPixels(canvas), 1, size, file) == size;
+        result = (fclose(file) == 0) && result;
+        return result;
+    }
+    
+    bool WritePpm(Canvas &canvas, const char *filename)
+    {
+        FILE *file = OpenFile(filename, "wb");
+        if(!file)
+            return false;
+        
+        fprintf(file, "P6\n%d %d\n255\n", canvas.width, canvas.height);
+        encoded.resize((size_t)canvas.width * 3);
+        bool result = true;
+        u8 *pixel = LinearPixels(canvas);
+        for(i32 y = 0; y < canvas.height; ++y)
+        {
+            u8 *rgb = encoded.data();
+            for(i32 x = 0; x < canvas.width; ++x, pixel += 4, rgb += 3)
+            {
+                rgb[0] = pixel[0];
+                rgb[1] = pixel[1];
+                rgb[2] = pixel[2];
+            }
+            result = result && fwrite(encoded.data(), 1, encoded.size(), file) == encoded.size();
+        }
+        result = (fclose(file) == 0) && result;
+        return result;
+    }
+    
+    // NOTE(mevex): BT.601 in the limited range, the default of the players that read Y4M
+    bool WriteY4mFrame(Canvas &canvas, const char *filename, int frameRate)
+    {
+        if(!video || videoFilename != filename)
+        {
+            CloseVideo();
+            video = OpenFile(filename, "wb");
+            if(!video)
+                return false;
+            
+            videoFilename = filename;
+            fprintf(video, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", canvas.width, canvas.height, frameRate);
+        }
+        
+        size_t pixelsCount = (size_t)canvas.width * canvas.height;
+        planes.resize(pixelsCount * 3);
+        u8 *yPlane = planes.data();
+        u8 *uPlane = yPlane + pixelsCount;
+        u8 *vPlane = uPlane + pixelsCount;
+        
+        u8 *pixel = LinearPixels(canvas);
+        for(size_t i = 0; i < pixelsCount; ++i, pixel += 4)
+        {
+            int r = pixel[0];
+            int g = pixel[1];
+            int b = pixel[2];
+            yPlane[i] = (u8)(((66*r + 129*g + 25*b + 128) >> 8) + 16);
+            uPlane[i] = (u8)(((-38*r - 74*g + 112*b + 128) >> 8) + 128);
+            vPlane[i] = (u8)(((112*r - 94*g - 18*b + 128) >> 8) + 128);
+        }
+        
+        fprintf(video, "FRAME\n");
+        bool result = fwrite(planes.data(), 1, planes.size(), video) == planes.size();
+        return result;
+    }
+    
+    // NOTE(mevex): Encodes into the encoded buffer. Only the formats that are compressed are encoded
+    //              in memory, the others return false and are written straight from the canvas.
+    bool Encode(Canvas &canvas, ImageSettings &settings)
+    {
+        bool result = true;
+        switch(settings.format)
+        {
+            case IMAGE_FORMAT_PNG:
+            {
+                EncodePng(LinearPixels(canvas), canvas.width, canvas.height, settings.compressionLevel, pool, encoded);
+            } break;
+            
+            case IMAGE_FORMAT_STB_PNG:
+            {
+                TIMED_ZONE("stbi_write_png_to_mem");
+                int size = 0;
+                u8 *png = stbi_write_png_to_mem(LinearPixels(canvas), 0, canvas.width, canvas.height, canvas.bytesPerPixel, &size);
+                result = png != NULL;
+                encoded.assign(png, png + size);
+                free(png);
+            } break;
+            
+            case IMAGE_FORMAT_QOI:
+            {
+                EncodeQoi(LinearPixels(canvas), canvas.width, canvas.height, encoded);
+            } break;
+            
+            default:
+            {
+                result = false;
+            } break;
+        }
+        return result;
+    }
+    
+    bool Write(Canvas &canvas, const char *filename, ImageSettings &settings)
+    {
+        TIMED_FUNCTION();
+        
+        bool result = false;
+        switch(settings.format)
+        {
+            case IMAGE_FORMAT_PNG:
+            case IMAGE_FORMAT_STB_PNG:
+            case IMAGE_FORMAT_QOI:
+            {
+                result = Encode(canvas, settings) && WriteEncoded(filename);
+            } break;
+            
+            case IMAGE_FORMAT_PAM:
+            {
+                result = WritePam(canvas, filename);
+            } break;
+            
+            case IMAGE_FORMAT_PPM:
+            {
+                result = WritePpm(canvas, filename);
+            } break;
+            
+            case IMAGE_FORMAT_Y4M:
+            {
+                result = WriteY4mFrame(canvas, filename, settings.frameRate);
+            } break;
+        }
+        return result;
+    }
+};
+
+#endif //IMAGEENCODER_H
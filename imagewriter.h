@@ -0,0 +1,122 @@
+#ifndef IMAGEWRITER_H
+#define IMAGEWRITER_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <string>
+
+struct ImageJob
+{
+    Canvas *canvas;
+    std::string filename;
+    ImageSettings settings;
+};
+
+// NOTE(mevex): Encodes and writes the images on a thread of its own, so the next frame is rendered
+//              while the previous one goes to disk. Submit hands over the canvas and returns a ticket:
+//              the canvas must not be drawn to again until Wait returns for that ticket.
+//              The images are written in submission order. The PNG bands are encoded by a pool of
+//              its own, the writer thread being its worker 0. It runs while the next frame is drawn,
+//              so by default it takes only a quarter of the cores and leaves the rest to the renderer.
+//              A WorkerPool runs one job at a time, it cannot be shared with the TileRenderer.
+class ImageWriter
+{
+    public:
+    
+    WorkerPool pool;
+    ImageEncoder encoder;
+    
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable submitCondition;
+    std::condition_variable writtenCondition;
+    std::deque<ImageJob> jobs;
+    u64 submittedCount;
+    u64 writtenCount;
+    u32 failedCount;
+    bool quit;
+    
+    ImageWriter(int encodeThreadsCount = Max(1, (int)std::thread::hardware_concurrency() / 4)) :
+    pool(encodeThreadsCount), encoder(&pool)
+    {
+        submittedCount = 0;
+        writtenCount = 0;
+        failedCount = 0;
+        quit = false;
+        thread = std::thread(&ImageWriter::WriterLoop, this);
+    }
+    
+    // NOTE(mevex): Writes whatever is still queued before returning
+    ~ImageWriter()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        submitCondition.notify_one();
+        thread.join();
+    }
+    
+    void WriterLoop()
+    {
+        while(true)
+        {
+            ImageJob job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                submitCondition.wait(lock, [&]{ return quit || !jobs.empty(); });
+                if(jobs.empty())
+                    return;
+                
+                job = jobs.front();
+                jobs.pop_front();
+            }
+            
+            bool written = encoder.Write(*job.canvas, job.filename.c_str(), job.settings);
+            
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ++writtenCount;
+                if(!written)
+                    ++failedCount;
+            }
+            writtenCondition.notify_all();
+        }
+    }
+    
+    u64 Submit(Canvas &canvas, const char *filename, ImageSettings settings = ImageSettings())
+    {
+        u64 ticket;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back({&canvas, filename, settings});
+            ticket = ++submittedCount;
+        }
+        submitCondition.notify_one();
+        return ticket;
+    }
+    
+    // NOTE(mevex): Ticket 0 is never handed out, waiting for it returns at once
+    void Wait(u64 ticket)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        writtenCondition.wait(lock, [&]{ return writtenCount >= ticket; });
+    }
+    
+    void WaitAll()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        writtenCondition.wait(lock, [&]{ return writtenCount >= submittedCount; });
+    }
+    
+    // NOTE(mevex): Images that could not be encoded or written so far
+    u32 FailedCount()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return failedCount;
+    }
+};
+
+#endif //IMAGEWRITER_H
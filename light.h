@@ -3,44 +3,148 @@
 
 #include "v3.h"
 #include "main.h"
+#include "simd.h"
 
-class Light
+// NOTE(mevex): All the lights of the scene, stored by type as structure of arrays so that a batch
+//              of vertices is lit against every light with no virtual calls. Like before, positions
+//              and directions are in the same space as the vertices they light (camera space).
+//              The ambient lights do not depend on the vertex, so they are summed once.
+struct LightSet
 {
-    public:
+    f32 ambientIntensity = 0.0f;
     
-    virtual f32 ComputeLightning(v3 normal, p3 hitPoint) = 0;
+    vector<f32> pointX;
+    vector<f32> pointY;
+    vector<f32> pointZ;
+    vector<f32> pointIntensity;
+    
+    // NOTE(mevex): Unit vectors pointing towards the light, normalized when the light is added
+    vector<f32> directionalX;
+    vector<f32> directionalY;
+    vector<f32> directionalZ;
+    vector<f32> directionalIntensity;
+    
+    void AddAmbient(f32 intensity)
+    {
+        ambientIntensity += intensity;
+    }
+    
+    void AddPoint(p3 position, f32 intensity)
+    {
+        pointX.push_back(position.x);
+        pointY.push_back(position.y);
+        pointZ.push_back(position.z);
+        pointIntensity.push_back(intensity);
+    }
+    
+    void AddDirectional(v3 direction, f32 intensity)
+    {
+        v3 unit = Unit(direction);
+        directionalX.push_back(unit.x);
+        directionalY.push_back(unit.y);
+        directionalZ.push_back(unit.z);
+        directionalIntensity.push_back(intensity);
+    }
 };
 
-struct PointLight : public Light
+// NOTE(mevex): Diffuse intensity of every vertex, the sum of intensity * max(n.l, 0) / (|n| |l|)
+//              over all the lights. The normals do not need to be unit length, their inverse
+//              length is computed once per vertex and not once per light.
+void ComputeLightIntensities(LightSet &lights, VertexStreams &positions, VertexStreams &normals, f32 *intensities)
 {
-    p3 position;
-    f32 intensity;
+    size_t count = positions.count;
+    Assert(normals.count == count);
+    
+    size_t pointsCount = lights.pointIntensity.size();
+    size_t directionalsCount = lights.directionalIntensity.size();
+    
+    // NOTE(mevex): Keeps a zero normal from turning 0/0 into a NaN, its n.l is 0 anyway
+    f32 minLengthSquared = 1e-30f;
     
-    PointLight(p3 p, f32 i) : position(p), intensity(i) {}
+    lane_f32 zero = LaneSet1(0.0f);
+    lane_f32 one = LaneSet1(1.0f);
+    lane_f32 wideMinLengthSquared = LaneSet1(minLengthSquared);
+    lane_f32 ambient = LaneSet1(lights.ambientIntensity);
     
-    f32 ComputeLightning(v3 normal, p3 hitPoint)
+    size_t i = 0;
+    for(; i + LANE_WIDTH <= count; i += LANE_WIDTH)
     {
-        f32 finalIntensity = 0;
+        lane_f32 px = LaneLoad(positions.x + i);
+        lane_f32 py = LaneLoad(positions.y + i);
+        lane_f32 pz = LaneLoad(positions.z + i);
+        lane_f32 nx = LaneLoad(normals.x + i);
+        lane_f32 ny = LaneLoad(normals.y + i);
+        lane_f32 nz = LaneLoad(normals.z + i);
         
-        v3 light = position - hitPoint;
-        f32 nDotL = Dot(normal, light);
-        if(nDotL > 0)
-            finalIntensity = intensity * nDotL / (normal.Length() * light.Length());
+        lane_f32 normalLengthSquared = LaneAdd(LaneAdd(LaneMul(nx, nx), LaneMul(ny, ny)), LaneMul(nz, nz));
+        lane_f32 invNormalLength = LaneDiv(one, LaneSqrt(LaneMax(normalLengthSquared, wideMinLengthSquared)));
         
-        return finalIntensity;
+        lane_f32 result = ambient;
+        for(size_t l = 0; l < pointsCount; ++l)
+        {
+            lane_f32 lx = LaneSub(LaneSet1(lights.pointX[l]), px);
+            lane_f32 ly = LaneSub(LaneSet1(lights.pointY[l]), py);
+            lane_f32 lz = LaneSub(LaneSet1(lights.pointZ[l]), pz);
+            
+            lane_f32 nDotL = LaneAdd(LaneAdd(LaneMul(nx, lx), LaneMul(ny, ly)), LaneMul(nz, lz));
+            lane_f32 lightLengthSquared = LaneAdd(LaneAdd(LaneMul(lx, lx), LaneMul(ly, ly)), LaneMul(lz, lz));
+            lane_f32 invLightLength = LaneDiv(one, LaneSqrt(LaneMax(lightLengthSquared, wideMinLengthSquared)));
+            
+            lane_f32 diffuse = LaneMul(LaneMul(LaneMax(nDotL, zero), invNormalLength), invLightLength);
+            result = LaneAdd(result, LaneMul(LaneSet1(lights.pointIntensity[l]), diffuse));
+        }
+        
+        for(size_t l = 0; l < directionalsCount; ++l)
+        {
+            lane_f32 nDotL = LaneAdd(LaneAdd(LaneMul(nx, LaneSet1(lights.directionalX[l])),
+                                             LaneMul(ny, LaneSet1(lights.directionalY[l]))),
+                                     LaneMul(nz, LaneSet1(lights.directionalZ[l])));
+            
+            lane_f32 diffuse = LaneMul(LaneMax(nDotL, zero), invNormalLength);
+            result = LaneAdd(result, LaneMul(LaneSet1(lights.directionalIntensity[l]), diffuse));
+        }
+        
+        LaneStore(intensities + i, result);
     }
-};
-
-struct AmbientLight : public Light
-{
-    f32 intensity;
-    
-    AmbientLight(f32 i) : intensity(i) {}
     
-    f32 ComputeLightning(v3 normal, p3 hitPoint)
+    // NOTE(mevex): Leftover vertices that do not fill a whole register, same operations in the same order
+    for(; i < count; ++i)
     {
-        return intensity;
+        f32 px = positions.x[i];
+        f32 py = positions.y[i];
+        f32 pz = positions.z[i];
+        f32 nx = normals.x[i];
+        f32 ny = normals.y[i];
+        f32 nz = normals.z[i];
+        
+        f32 normalLengthSquared = nx*nx + ny*ny + nz*nz;
+        f32 invNormalLength = 1.0f / sqrtf(Max(normalLengthSquared, minLengthSquared));
+        
+        f32 result = lights.ambientIntensity;
+        for(size_t l = 0; l < pointsCount; ++l)
+        {
+            f32 lx = lights.pointX[l] - px;
+            f32 ly = lights.pointY[l] - py;
+            f32 lz = lights.pointZ[l] - pz;
+            
+            f32 nDotL = nx*lx + ny*ly + nz*lz;
+            f32 lightLengthSquared = lx*lx + ly*ly + lz*lz;
+            f32 invLightLength = 1.0f / sqrtf(Max(lightLengthSquared, minLengthSquared));
+            
+            f32 diffuse = Max(nDotL, 0.0f);
+            diffuse = diffuse * invNormalLength * invLightLength;
+            result += lights.pointIntensity[l] * diffuse;
+        }
+        
+        for(size_t l = 0; l < directionalsCount; ++l)
+        {
+            f32 nDotL = nx*lights.directionalX[l] + ny*lights.directionalY[l] + nz*lights.directionalZ[l];
+            f32 diffuse = Max(nDotL, 0.0f);
+            result += lights.directionalIntensity[l] * (diffuse * invNormalLength);
+        }
+        
+        intensities[i] = result;
     }
-};
+}
 
 #endif //LIGHT_H
@@ -1,319 +1,45 @@
 #include "main.h"
 #include <chrono>
+#include <atomic>
+#include <new>
 
-// NOTE(mevex): This routine works only if the mesh has been triangulated
-bool LoadObj(Mesh *mesh, const char* filename, const char* basepath = NULL, bool triangulate = true)
-{
-    printf("Loading %s\n", filename);
-    
-    tinyobj::attrib_t attrib;
-    vector<tinyobj::shape_t> shapes;
-    vector<tinyobj::material_t> materials;
-    
-    std::string warn;
-    std::string err;
-    bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filename, basepath, triangulate);
-    
-    if (!warn.empty()) {
-        printf("WARN: %s\n", warn.c_str());
-    }
-    if (!err.empty()) {
-        printf("ERR: %s\n", err.c_str());
-    }
-    if (!ret) {
-        printf("Failed to load/parse .obj.\n");
-        return false;
-    }
-    
-    // NOTE(mevex): Get the color indices
-    vector<Color> colors;
-    for(tinyobj::material_t m : materials)
-    {
-        Color c(m.diffuse[0], m.diffuse[1], m.diffuse[2]);
-        colors.push_back(c);
-    }
-    
-    // NOTE(mevex): Fill the vertices array
-    int vertexCount = (int)attrib.vertices.size() / 3;
-    for(int i = 0; i < vertexCount; i++)
-    {
-        p3 vertex(attrib.vertices[3*i], attrib.vertices[3*i + 1], attrib.vertices[3*i + 2]);
-        mesh->Add(vertex);
-    }
-    
-    // NOTE(mevex): Fill the triangles array
-    int facesCount = (int)shapes[0].mesh.num_face_vertices.size();
-    tinyobj::index_t *indexPtr = &shapes[0].mesh.indices[0];
-    int *materialIndex = &shapes[0].mesh.material_ids[0];
-    
-    for(int i = 0; i < facesCount; i++)
-    {
-        Triangle t = {};
-        
-        t.a = indexPtr->vertex_index;
-        indexPtr++;
-        t.b = indexPtr->vertex_index;
-        indexPtr++;
-        t.c = indexPtr->vertex_index;
-        indexPtr++;
-        
-        t.color = colors[materialIndex[i]];
-        
-        mesh->Add(t);
-    }
-    
-    mesh->CalculateBoundingSphere();
-    
-    return true;
-}
+// NOTE(mevex): Set to a number of frames to render an animation of the scene instead of a single image
+#ifndef ANIMATION_FRAMES
+#define ANIMATION_FRAMES 0
+#endif
 
-int ClipSphere(Sphere s, Plane clippingPlane)
-{
-    f32 distance = Dot(s.center, clippingPlane.normal) + clippingPlane.d;
-    
-    if(Abs(distance) < s.r)
-        return UNKNOWN;
-    else if(distance < -s.r)
-        return DISCARDED;
-    return ACCEPTED;
-}
+// NOTE(mevex): Every heap allocation done through new is counted, so we can check that
+//              rendering a frame in the steady state does not touch the heap
+global_variable std::atomic<u64> globalHeapAllocationsCount;
 
-vector<Triangle> ClipTriangles(vector<Triangle> &tris, vector<p3> &vertices, Plane clippingPlane)
+void *operator new(size_t size)
 {
-    size_t trisCount = tris.size();
-    vector<Triangle> resultingTris;
-    vector<p3> resultingVerts = vertices;
-    int vertsIndex = 0;
-    
-    int accepted = 0;
-    int modified = 0;
-    int discarded = 0;
-    for(int i = 0; i < trisCount; ++i)
-    {
-        Triangle tri = tris[i];
-        p3 a = vertices[tri.a];
-        p3 b = vertices[tri.b];
-        p3 c = vertices[tri.c];
-        
-        f32 dA = Dot(a, clippingPlane.normal) + clippingPlane.d;
-        f32 dB = Dot(b, clippingPlane.normal) + clippingPlane.d;
-        f32 dC = Dot(c, clippingPlane.normal) + clippingPlane.d;
-        
-        int positives = CountPositives(3, dA, dB, dC);
-        if(positives == 3)
-        {
-            ++accepted;
-            resultingTris.push_back(tri);
-        }
-        else if(positives == 1)
-        {
-            ++modified;
-            
-            int newAIndex = tri.a;
-            if(dB > ZERO)
-            {
-                Swap(a, b);
-                newAIndex = tri.b;
-            }
-            else if(dC > ZERO)
-            {
-                Swap(a, c);
-                newAIndex = tri.c;
-            }
-            
-            f32 tNumerator = (-clippingPlane.d - Dot(clippingPlane.normal, a));
-            f32 tAB = tNumerator / Dot(clippingPlane.normal, b-a);
-            f32 tAC = tNumerator / Dot(clippingPlane.normal, c-a);
-            
-            p3 newB = Lerp(a, b, tAB);
-            p3 newC = Lerp(a, c, tAC);
-            
-            resultingVerts.push_back(newB);
-            int newBIndex = int(resultingVerts.size() - 1);
-            resultingVerts.push_back(newC);
-            int newCIndex = newBIndex + 1;
-            
-            Triangle t = {newAIndex, newBIndex, newCIndex, tri.color};
-            resultingTris.push_back(t);
-        }
-        else if(positives == 2)
-        {
-            ++modified;
-            
-            int aIndex = tri.a;
-            int bIndex = tri.b;
-            if(dA < -ZERO)
-            {
-                Swap(a, c);
-                aIndex = tri.c;
-            }
-            else if(dB < -ZERO)
-            {
-                Swap(b, c);
-                bIndex = tri.c;
-            }
-            
-            dA = Dot(a, clippingPlane.normal) + clippingPlane.d;
-            dB = Dot(b, clippingPlane.normal) + clippingPlane.d;
-            dC = Dot(c, clippingPlane.normal) + clippingPlane.d;
-            
-            f32 tNumerator = (-clippingPlane.d - Dot(clippingPlane.normal, c));
-            f32 tCA = tNumerator / Dot(clippingPlane.normal, a-c);
-            f32 tCB = tNumerator / Dot(clippingPlane.normal, b-c);
-            
-            p3 aPrime = Lerp(c, a, tCA);
-            p3 bPrime = Lerp(c, b, tCB);
-            
-            resultingVerts.push_back(aPrime);
-            int aPrimeIndex = int(resultingVerts.size() - 1);
-            resultingVerts.push_back(bPrime);
-            int bPrimeIndex = aPrimeIndex + 1;
-            
-            Triangle t1 = {aIndex, bIndex, aPrimeIndex, tri.color};
-            Triangle t2 = {aPrimeIndex, bIndex, bPrimeIndex, tri.color};
-            resultingTris.push_back(t1);
-            resultingTris.push_back(t2);
-        }
-        else
-        {
-            ++discarded;
-        }
-        
-    }
-    printf("Accepted:%i Modified:%i Discarded:%i\n", accepted, modified, discarded);
-    vertices = resultingVerts;
-    return resultingTris;
+    ++globalHeapAllocationsCount;
+    void *result = malloc(size ? size : 1);
+    if(!result)
+        throw std::bad_alloc();
+    return result;
 }
 
-vector<v3> CalculateNormals(vector<Triangle> &tris, vector<p3> &vertices)
+void operator delete(void *p) noexcept
 {
-    size_t trisCount = tris.size();
-    vector<v3> normals(trisCount);
-    for(int i = 0; i < trisCount; i++)
-    {
-        v3 vBA = vertices[tris[i].b] - vertices[tris[i].a];
-        v3 vCA = vertices[tris[i].c] - vertices[tris[i].a];
-        
-        v3 n = Cross(vBA, vCA);
-        normals[i] = n;
-    }
-    
-    return normals;
+    free(p);
 }
 
-vector<Triangle> CullBackFace(vector<Triangle> &tris, vector<p3> &vertices, vector<v3> &normals)
+void operator delete(void *p, size_t size) noexcept
 {
-    size_t trisCount = tris.size();
-    vector<Triangle> resultingTris;
-    vector<v3> remainingNormals;
-    
-    for(int i = 0; i < trisCount; ++i)
-    {
-        v3 v = vertices[tris[i].a];
-        v3 n = normals[i];
-        
-        if(Dot(n, v) < 0)
-        {
-            resultingTris.push_back(tris[i]);
-            remainingNormals.push_back(normals[i]);
-        }
-    }
-    
-    normals = remainingNormals;
-    return resultingTris;
+    free(p);
 }
 
-void Render(vector<Instance> &instances, vector<Light*> lights, Canvas &canv, Camera &cam)
-{
-    canv.FillEntireCanvas(Color(0.2f,0.5f,0.7f));
-    
-    for(auto inst: instances)
-    {
-        // NOTE(mevex): Apply the inst transform in the following order:
-        //              scale -> rotation -> position;
-        m4x4 instTransform = Translation(inst.position) * ((ZRotation(inst.rotations[Z]) * YRotation(inst.rotations[Y]) * XRotation(inst.rotations[X])) * Scale(inst.scale));
-        m4x4 absoluteTransform = cam.transform * instTransform;
-        
-        size_t verticesCount = inst.mesh->vertices.size();
-        // NOTE(mevex): Apply the absolute transfom
-        vector<p3> transformedVertices(verticesCount);
-        for(int i = 0; i < verticesCount; ++i)
-        {
-            p4 homogP = HomogeneousPoint(inst.mesh->vertices[i]);
-            transformedVertices[i] = NotHomogeneous(absoluteTransform*homogP);
-        }
-        Sphere testSphere = inst.mesh->boundingSphere;
-        testSphere.center = NotHomogeneous(absoluteTransform * HomogeneousPoint(testSphere.center));
-        
-        // NOTE(mevex): Clipping
-        int clipping = ACCEPTED;
-        vector<Plane> unknownPlanes;
-        for(auto p : cam.clippingPlanes)
-        {
-            int result = ClipSphere(testSphere, p);
-            
-            if(result == DISCARDED)
-            {
-                clipping = DISCARDED;
-                break;
-            }
-            else if(result == UNKNOWN)
-            {
-                clipping = UNKNOWN;
-                unknownPlanes.push_back(p);
-            }
-        }
-        if(clipping == DISCARDED)
-            continue;
-        
-        vector<v3> normals = CalculateNormals(inst.mesh->triangles, transformedVertices);
-        vector<Triangle> newTriangles = CullBackFace(inst.mesh->triangles, transformedVertices, normals);
-        
-        for(auto p : unknownPlanes)
-            newTriangles = ClipTriangles(newTriangles, transformedVertices, p);
-        
-        // NOTE(mevex): We need to do this in case we add new vertices
-        verticesCount = transformedVertices.size();
-        // NOTE(mevex): Project each vertex
-        vector<p3> projectedVertices(verticesCount);
-        for(int i = 0; i < verticesCount; ++i)
-            projectedVertices[i] = cam.Project(transformedVertices[i]);
-        
-        // NOTE(mevex):  Compute lightning and draw each triangle
-        int trianglesIndex = 0;
-        for(auto t : newTriangles)
-        {
-            f32 intensityA = 0.0f;
-            f32 intensityB = 0.0f;
-            f32 intensityC = 0.0f;
-            
-            for(auto l : lights)
-            {
-                v3 n = normals[trianglesIndex];
-                p3 vertA = transformedVertices[t.a];
-                p3 vertB = transformedVertices[t.b];
-                p3 vertC = transformedVertices[t.c];
-                
-                intensityA += l->ComputeLightning(n, vertA);
-                intensityB += l->ComputeLightning(n, vertB);
-                intensityC += l->ComputeLightning(n, vertC);
-                
-                Assert(intensityA >= 0.0f && intensityA <= 1.0f);
-                Assert(intensityB >= 0.0f && intensityB <= 1.0f);
-                Assert(intensityC >= 0.0f && intensityC <= 1.0f);
-            }
-            
-            DrawFilledTriangle(projectedVertices[t.a], projectedVertices[t.b], projectedVertices[t.c], intensityA, intensityB, intensityC, t.color, canv);
-            ++trianglesIndex;
-        }
-        
-        printf("Render\n");
-    }
-}
+#include "render.cpp"
 
 int main()
 {
     Canvas canvas(1280, 720, 4);
+    // NOTE(mevex): The float color buffer pays off with overdraw or several passes, this scene has little of both
+#if 0
+    canvas.EnableHdr();
+#endif
     Camera cam(p3(3,1,5), p3(0,0,-5), v3(0,1,0), 60.0f, canvas);
     
     Mesh fox;
@@ -326,8 +52,12 @@ int main()
     //instance.rotations[X] = 20;
     instance.position = p3(0,0,-5);
     
-    LoadObj(&fox, "../models/fox.obj", "../models/");
-    LoadObj(&sphere, "../models/sphere.obj", "../models/");
+    {
+        WorkerPool loadPool((int)std::thread::hardware_concurrency());
+        LoadObj(&fox, "../models/fox.obj", "../models/", loadPool);
+        LoadObj(&sphere, "../models/sphere.obj", "../models/", loadPool);
+    }
+    
     vector<Instance> scene;
     for(int i = 0; i < 10; ++i)
     {
@@ -372,31 +102,112 @@ int main()
         scene.push_back(inst);
     }
     
-    PointLight l1(p3(10,20,50), 0.8f);
-    AmbientLight l2(0.20f);
-    vector<Light*> lights;
-    lights.push_back(&l1);
-    lights.push_back(&l2);
+    LightSet lights;
+    lights.AddPoint(p3(10,20,50), 0.8f);
+    lights.AddAmbient(0.20f);
+    
+    RenderSettings settings;
+    settings.rasterizer = RASTERIZER_FIXED_POINT;
+    
+    // NOTE(mevex): The image writer encodes a frame while the next one is drawn, an animation
+    //              leaves it a quarter of the cores and the tiles get the rest
+    int threadsCount = (int)std::thread::hardware_concurrency();
+#if ANIMATION_FRAMES
+    int encodeThreadsCount = Max(1, threadsCount / 4);
+    threadsCount = Max(1, threadsCount - encodeThreadsCount);
+#endif
+#if 1
+    TileRenderer tiles(canvas, 64, threadsCount);
+    settings.tiles = &tiles;
+#endif
+    
+    InstanceBVH bvh;
+    bvh.Build(scene);
+    settings.bvh = &bvh;
+    
+#if 0
+    VisibilityBuffer visibility(canvas);
+    settings.visibility = &visibility;
+#endif
+    
+    DepthPyramid occlusion;
+    settings.occlusion = &occlusion;
+    settings.sortInstances = true;
+    
+#if RENDER_STATS
+    PipelineStats pipelineStats(settings.tiles ? settings.tiles->pool.workersCount : 1, canvas, true);
+    settings.stats = &pipelineStats;
+#endif
+    
+    MemoryArena frameArena;
+    
+    // NOTE(mevex): Level 0 stores the PNG rows uncompressed, for when writing must not slow down rendering
+    ImageSettings imageSettings;
+    imageSettings.format = IMAGE_FORMAT_PNG;
+    imageSettings.compressionLevel = 6;
     
     // NOTE(mevex): Timer start
     printf("Rendering starts\n");
+    u64 heapAllocationsStart = globalHeapAllocationsCount;
     auto timerStart = std::chrono::high_resolution_clock::now();
     
-#if 1
-    Render(scene, lights, canvas, cam);
+#if ANIMATION_FRAMES
+    // NOTE(mevex): The camera swings around the scene and back while the last fox turns around once
+    Canvas backCanvas(canvas.width, canvas.height, canvas.bytesPerPixel, canvas.layout.type, canvas.depthFormat);
+    if(canvas.hdr)
+        backCanvas.EnableHdr();
+    Animation animation;
+    animation.AddCameraKey(0.0f, p3(3,1,5), p3(0,0,-5));
+    animation.AddCameraKey(2.0f, p3(-8,6,4), p3(0,0,-10));
+    animation.AddCameraKey(4.0f, p3(3,1,5), p3(0,0,-5));
+    
+    Instance spin = scene[9];
+    animation.AddInstanceKey(9, 0.0f, spin);
+    spin.rotations[Y] += 360;
+    animation.AddInstanceKey(9, 4.0f, spin);
+    
+    ImageWriter writer(encodeThreadsCount);
+    f32 fps = ANIMATION_FRAMES / animation.Duration();
+    imageSettings.frameRate = Max(1, (int)roundf(fps));
+    RenderStats stats = RenderAnimation(animation, ANIMATION_FRAMES, fps, "../renders/frame_%04d.png",
+                                        scene, lights, canvas, backCanvas, settings, frameArena, writer, imageSettings);
+#elif 1
+    RenderStats stats = Render(scene, lights, canvas, cam, settings, frameArena);
 #else
     vector<Instance> test;
     test.push_back(instance);
-    Render(test, lights, canvas, cam);
+    RenderStats stats = Render(test, lights, canvas, cam, settings, frameArena);
 #endif
     
     // NOTE(mevex): Time finish
     auto timerFinish = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(timerFinish - timerStart);
     
-    // NOTE(mevex): Pixel order: AABBGGRR
-    auto res = stbi_write_png("../renders/render.png", canvas.width, canvas.height, canvas.bytesPerPixel, canvas.memory, 0);
+#if !ANIMATION_FRAMES
+    // NOTE(mevex): Pixel order: AABBGGRR. The tile renderer threads are idle now, they encode the PNG bands.
+    ImageEncoder encoder(settings.tiles ? &settings.tiles->pool : NULL);
+    if(!encoder.Write(canvas, "../renders/render.png", imageSettings))
+        printf("Could not write ../renders/render.png\n");
+#else
+    u32 failedCount = writer.FailedCount();
+    if(failedCount)
+        printf("Could not write %u of the %d frames\n", failedCount, ANIMATION_FRAMES);
+#endif
     
+    printf("\nFrame arena: %u pushes, %zu KB peak, %u heap allocations since start\n",
+           frameArena.pushesCount, frameArena.peakUsed / 1024, frameArena.heapAllocationsCount);
+    printf("Heap allocations during the frame: %llu\n", (unsigned long long)(globalHeapAllocationsCount - heapAllocationsStart));
+    printf("Vertices processed: %llu of %llu (%.1f%%)\n",
+           (unsigned long long)stats.processedVerticesCount, (unsigned long long)stats.meshVerticesCount,
+           stats.meshVerticesCount ? 100.0 * stats.processedVerticesCount / stats.meshVerticesCount : 0.0);
+#if RENDER_STATS
+    printf("\n");
+    pipelineStats.Print();
+    pipelineStats.WriteOverdrawHeatmap("../renders/overdraw.png");
+#endif
+#if PROFILER
+    WriteProfilerTrace("../renders/trace.json");
+#endif
     printf("\nRendering time: %ims", (int)(duration.count()));
     getchar();
     return 0;
@@ -95,6 +95,9 @@ int CountPositives(int n, ...)
 #include <vector>
 using std::vector;
 
+#include "platform.h"
+#include "profiler.h"
+
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "external/stb_image_write.h"
 
@@ -103,9 +106,126 @@ using std::vector;
 
 #include "v3.h"
 #include "v4.h"
+#include "arena.h"
 #include "mesh.h"
+#include "meshcache.h"
+#include "workers.h"
+#include "objloader.h"
 #include "light.h"
 
+enum canvas_layout
+{
+    CANVAS_LAYOUT_LINEAR,
+    CANVAS_LAYOUT_TILED,
+    
+    CANVAS_LAYOUTS_COUNT
+};
+
+// NOTE(mevex): Every format stores the reverse depth 1/w, 1 on the near plane (w = 1) and 0 at
+//              infinity, so the buffer is cleared to 0 and the nearer pixel is the greater one.
+//              1/w is affine in screen space, unlike w, so interpolating it across the triangle
+//              is perspective correct. In a float the reverse depth keeps its precision far away,
+//              where the exponent shrinks together with the value. The unorm formats spread their
+//              steps evenly on 1/w, so they lose precision with distance like a classic z buffer.
+//              UNORM24 is kept in 32 bits, there is no stencil to pack next to it.
+enum depth_format
+{
+    DEPTH_FORMAT_UNORM16,
+    DEPTH_FORMAT_UNORM24,
+    DEPTH_FORMAT_FLOAT32,
+    
+    DEPTH_FORMATS_COUNT
+};
+
+global_variable const char *depthFormatNames[DEPTH_FORMATS_COUNT] =
+{
+    "unorm16",
+    "unorm24",
+    "float32",
+};
+
+global_variable size_t depthFormatSizes[DEPTH_FORMATS_COUNT] =
+{
+    sizeof(u16),
+    sizeof(u32),
+    sizeof(f32),
+};
+
+// NOTE(mevex): Depth test of a single pixel, writes the depth and returns true when it passes.
+//              A template so the rasterizers can pick the format once per triangle.
+template <int format>
+inline bool DepthTest(void *buffer, size_t offset, f32 depth)
+{
+    if constexpr(format == DEPTH_FORMAT_FLOAT32)
+    {
+        f32 *z = (f32 *)buffer + offset;
+        if(depth <= *z)
+            return false;
+        *z = depth;
+        return true;
+    }
+    
+    // NOTE(mevex): Interpolation can overshoot the near plane a little, the clamp keeps it from wrapping
+    depth = Min(Max(depth, 0.0f), 1.0f);
+    if constexpr(format == DEPTH_FORMAT_UNORM16)
+    {
+        u16 value = (u16)(depth*65535.0f + 0.5f);
+        u16 *z = (u16 *)buffer + offset;
+        if(value <= *z)
+            return false;
+        *z = value;
+        return true;
+    }
+    
+    u32 value = (u32)(depth*16777215.0f + 0.5f);
+    u32 *z = (u32 *)buffer + offset;
+    if(value <= *z)
+        return false;
+    *z = value;
+    return true;
+}
+
+// NOTE(mevex): Side of the blocks of the tiled layout, a power of two
+#define CANVAS_BLOCK_SHIFT 3
+#define CANVAS_BLOCK_SIZE (1 << CANVAS_BLOCK_SHIFT)
+
+// NOTE(mevex): Where a pixel lives in the color, depth and hdr buffers. The offset is split in a part
+//              that depends only on the row and one that depends only on the column, so a rasterizer
+//              computes the row part once per row and the column part with two masks and a shift.
+//              - LINEAR: rows top down (y is flipped), pixels left to right, what the image files want
+//              - TILED: 8x8 blocks stored one after the other, rows of blocks bottom up. A triangle
+//                touches far fewer cache lines and pages, images need a Detile first.
+struct PixelLayout
+{
+    int type;
+    i32 height;
+    
+    size_t rowBlockStride;
+    i32 rowShift;
+    i32 rowLowMask;
+    i32 rowLowStride;
+    
+    u32 columnHighMask;
+    i32 columnShift;
+    u32 columnLowMask;
+    
+    inline size_t Row(i32 y)
+    {
+        i32 row = (type == CANVAS_LAYOUT_LINEAR) ? height - y - 1 : y;
+        return (size_t)(row >> rowShift)*rowBlockStride + (size_t)((row & rowLowMask)*rowLowStride);
+    }
+    
+    inline size_t Column(i32 x)
+    {
+        return (size_t)(((u32)x & columnHighMask) << columnShift) + ((u32)x & columnLowMask);
+    }
+    
+    inline size_t Offset(i32 x, i32 y)
+    {
+        return Row(y) + Column(x);
+    }
+};
+
 class Canvas
 {
     public:
@@ -115,39 +235,177 @@ class Canvas
     i32 bytesPerPixel;
     f32 ratio;
     void *memory;
-    f32 *zBuffer;
+    // NOTE(mevex): Element size and meaning depend on depthFormat
+    void *zBuffer;
+    int depthFormat;
     
-    Canvas(i32 w, i32 h, i32 bpp)
+    PixelLayout layout;
+    // NOTE(mevex): Pixels in every buffer, the tiled layout pads the canvas to whole blocks
+    size_t pixelsCount;
+    
+    // NOTE(mevex): Linear color, one plane per channel with the pixels in the same order as memory.
+    //              It exists only after EnableHdr, then the pixels are written here in float and
+    //              Resolve does the clamping, the gamma and the packing of all of them at once,
+    //              so the pixels drawn over do not pay for it.
+    f32 *hdr;
+    f32 *hdrRed;
+    f32 *hdrGreen;
+    f32 *hdrBlue;
+    
+    Canvas(i32 w, i32 h, i32 bpp, int layoutType = CANVAS_LAYOUT_LINEAR, int depth = DEPTH_FORMAT_FLOAT32)
     {
+        hdr = NULL;
+        hdrRed = NULL;
+        hdrGreen = NULL;
+        hdrBlue = NULL;
+        
         width = w;
         height = h;
         bytesPerPixel = bpp;
         ratio = (f32)w / (f32)h;
-        memory = malloc(bpp * w * h);
         
-        zBuffer = (f32*)malloc(sizeof(f32) * w * h);
-        std::fill(zBuffer, zBuffer + (width*height), INFINITY);
+        layout.type = layoutType;
+        layout.height = h;
+        if(layoutType == CANVAS_LAYOUT_TILED)
+        {
+            i32 blocksX = (w + CANVAS_BLOCK_SIZE - 1) / CANVAS_BLOCK_SIZE;
+            i32 blocksY = (h + CANVAS_BLOCK_SIZE - 1) / CANVAS_BLOCK_SIZE;
+            pixelsCount = (size_t)blocksX * blocksY * CANVAS_BLOCK_SIZE * CANVAS_BLOCK_SIZE;
+            
+            layout.rowBlockStride = (size_t)blocksX * CANVAS_BLOCK_SIZE * CANVAS_BLOCK_SIZE;
+            layout.rowShift = CANVAS_BLOCK_SHIFT;
+            layout.rowLowMask = CANVAS_BLOCK_SIZE - 1;
+            layout.rowLowStride = CANVAS_BLOCK_SIZE;
+            layout.columnHighMask = ~(u32)(CANVAS_BLOCK_SIZE - 1);
+            layout.columnShift = CANVAS_BLOCK_SHIFT;
+            layout.columnLowMask = CANVAS_BLOCK_SIZE - 1;
+        }
+        else
+        {
+            pixelsCount = (size_t)w * h;
+            
+            layout.rowBlockStride = (size_t)w;
+            layout.rowShift = 0;
+            layout.rowLowMask = 0;
+            layout.rowLowStride = 0;
+            layout.columnHighMask = ~(u32)0;
+            layout.columnShift = 0;
+            layout.columnLowMask = 0;
+        }
+        
+        memory = malloc(bpp * pixelsCount);
+        depthFormat = depth;
+        zBuffer = malloc(depthFormatSizes[depth] * pixelsCount);
+        ClearDepth();
     }
     
-    void SetPixel(i32 x, i32 y, f32 red, f32 green, f32 blue)
+    void EnableHdr()
     {
-        if(x < 0 || x >= width ||
-           y < 0 || y >= height)
+        if(hdr)
+            return;
+        
+        hdr = (f32 *)malloc(3 * sizeof(f32) * pixelsCount);
+        hdrRed = hdr;
+        hdrGreen = hdr + pixelsCount;
+        hdrBlue = hdr + 2*pixelsCount;
+        std::fill(hdr, hdr + 3*pixelsCount, 0.0f);
+    }
+    
+    // NOTE(mevex): No bounds check, offset comes from layout. The color is clamped to [0, 1] like
+    //              Resolve does, so drawing straight to memory or through the float buffer agree.
+    inline void WritePixel(size_t offset, f32 red, f32 green, f32 blue)
+    {
+        if(hdr)
+        {
+            hdrRed[offset] = red;
+            hdrGreen[offset] = green;
+            hdrBlue[offset] = blue;
             return;
+        }
         
-        red = Min(red, 255);
-        green = Min(green, 255);
-        blue = Min(blue, 255);
+        red = Min(Max(red, 0.0f), 1.0f);
+        green = Min(Max(green, 0.0f), 1.0f);
+        blue = Min(Max(blue, 0.0f), 1.0f);
         
-        u8 r,g,b;
+        u32 r,g,b;
         
-        r = (u8)(255.99f * sqrt(red));
-        g = (u8)(255.99f * sqrt(green));
-        b = (u8)(255.99f * sqrt(blue));
+        r = (u32)(255.99f * sqrtf(red));
+        g = (u32)(255.99f * sqrtf(green));
+        b = (u32)(255.99f * sqrtf(blue));
         
-        i32* pixel = (i32*)memory;
-        pixel += (height-y-1)*width + x;
-        *pixel = 255<<24 | b << 16 | g << 8 | r;
+        u32 *pixel = (u32 *)memory + offset;
+        *pixel = 255u<<24 | b << 16 | g << 8 | r;
+    }
+    
+    inline void WritePixel(size_t offset, Color c)
+    {
+        WritePixel(offset, c.r, c.g, c.b);
+    }
+    
+    // NOTE(mevex): WritePixel for the LANE_WIDTH pixels one after the other from offset, only the
+    //              lanes set in mask (see LaneMoveMask) are written. Same operations, same result.
+    inline void WritePixels(size_t offset, lane_f32 red, lane_f32 green, lane_f32 blue, int mask)
+    {
+        int allLanes = (1 << LANE_WIDTH) - 1;
+        if(hdr)
+        {
+            if(mask == allLanes)
+            {
+                LaneStore(hdrRed + offset, red);
+                LaneStore(hdrGreen + offset, green);
+                LaneStore(hdrBlue + offset, blue);
+                return;
+            }
+            
+            f32 r[LANE_WIDTH];
+            f32 g[LANE_WIDTH];
+            f32 b[LANE_WIDTH];
+            LaneStore(r, red);
+            LaneStore(g, green);
+            LaneStore(b, blue);
+            for(int lane = 0; lane < LANE_WIDTH; ++lane)
+            {
+                if(mask & (1 << lane))
+                {
+                    hdrRed[offset + lane] = r[lane];
+                    hdrGreen[offset + lane] = g[lane];
+                    hdrBlue[offset + lane] = b[lane];
+                }
+            }
+            return;
+        }
+        
+        lane_f32 zero = LaneSet1(0.0f);
+        lane_f32 one = LaneSet1(1.0f);
+        lane_f32 maxValue = LaneSet1(255.99f);
+        lane_u32 ri = LaneTruncate(LaneMul(maxValue, LaneSqrt(LaneMin(LaneMax(red, zero), one))));
+        lane_u32 gi = LaneTruncate(LaneMul(maxValue, LaneSqrt(LaneMin(LaneMax(green, zero), one))));
+        lane_u32 bi = LaneTruncate(LaneMul(maxValue, LaneSqrt(LaneMin(LaneMax(blue, zero), one))));
+        lane_u32 packed = LaneOr(LaneOr(LaneSet1U32(255u << 24), LaneShiftLeft(bi, 16)), LaneOr(LaneShiftLeft(gi, 8), ri));
+        
+        u32 *pixel = (u32 *)memory + offset;
+        if(mask == allLanes)
+        {
+            LaneStoreU32(pixel, packed);
+            return;
+        }
+        
+        u32 values[LANE_WIDTH];
+        LaneStoreU32(values, packed);
+        for(int lane = 0; lane < LANE_WIDTH; ++lane)
+        {
+            if(mask & (1 << lane))
+                pixel[lane] = values[lane];
+        }
+    }
+    
+    void SetPixel(i32 x, i32 y, f32 red, f32 green, f32 blue)
+    {
+        if(x < 0 || x >= width ||
+           y < 0 || y >= height)
+            return;
+        
+        WritePixel(layout.Offset(x, y), red, green, blue);
     }
     
     void SetPixel(i32 x, i32 y, Color c)
@@ -164,23 +422,171 @@ class Canvas
     
     void FillEntireCanvas(Color c = {0,0,0})
     {
+        if(hdr)
+        {
+            std::fill(hdrRed, hdrRed + pixelsCount, c.r);
+            std::fill(hdrGreen, hdrGreen + pixelsCount, c.g);
+            std::fill(hdrBlue, hdrBlue + pixelsCount, c.b);
+            return;
+        }
+        
         u8 r = (u8)(255.99f * sqrt(c.r));
         u8 g = (u8)(255.99f * sqrt(c.g));
         u8 b = (u8)(255.99f * sqrt(c.b));
         
         u32 *begin = (u32 *)memory;
-        u32 *end = begin + (width*height);
+        u32 *end = begin + pixelsCount;
         u32 value = (u32)(255<<24 | b << 16 | g << 8 | r);
         std::fill(begin, end, value);
     }
     
+    void ClearDepth()
+    {
+        memset(zBuffer, 0, depthFormatSizes[depthFormat] * pixelsCount);
+    }
+    
+    // NOTE(mevex): For the paths that do not bother to pick the format up front
+    inline bool DepthTest(size_t offset, f32 depth)
+    {
+        switch(depthFormat)
+        {
+            case DEPTH_FORMAT_UNORM16: return ::DepthTest<DEPTH_FORMAT_UNORM16>(zBuffer, offset, depth);
+            case DEPTH_FORMAT_UNORM24: return ::DepthTest<DEPTH_FORMAT_UNORM24>(zBuffer, offset, depth);
+            default: return ::DepthTest<DEPTH_FORMAT_FLOAT32>(zBuffer, offset, depth);
+        }
+    }
+    
+    // NOTE(mevex): Resolves count pixels one after the other in the buffers
+    void ResolveSpan(size_t offset, size_t count, f32 scale)
+    {
+        lane_f32 wideScale = LaneSet1(scale);
+        lane_f32 zero = LaneSet1(0.0f);
+        lane_f32 one = LaneSet1(1.0f);
+        lane_f32 maxValue = LaneSet1(255.99f);
+        lane_u32 alpha = LaneSet1U32(255u << 24);
+        
+        f32 *red = hdrRed + offset;
+        f32 *green = hdrGreen + offset;
+        f32 *blue = hdrBlue + offset;
+        u32 *pixel = (u32 *)memory + offset;
+        
+        size_t i = 0;
+        for(; i + LANE_WIDTH <= count; i += LANE_WIDTH)
+        {
+            lane_f32 r = LaneMin(LaneMax(LaneMul(LaneLoad(red + i), wideScale), zero), one);
+            lane_f32 g = LaneMin(LaneMax(LaneMul(LaneLoad(green + i), wideScale), zero), one);
+            lane_f32 b = LaneMin(LaneMax(LaneMul(LaneLoad(blue + i), wideScale), zero), one);
+            
+            lane_u32 ri = LaneTruncate(LaneMul(maxValue, LaneSqrt(r)));
+            lane_u32 gi = LaneTruncate(LaneMul(maxValue, LaneSqrt(g)));
+            lane_u32 bi = LaneTruncate(LaneMul(maxValue, LaneSqrt(b)));
+            
+            lane_u32 packed = LaneOr(LaneOr(alpha, LaneShiftLeft(bi, 16)), LaneOr(LaneShiftLeft(gi, 8), ri));
+            LaneStoreU32(pixel + i, packed);
+        }
+        
+        // NOTE(mevex): Leftover pixels, same operations in the same order
+        for(; i < count; ++i)
+        {
+            f32 r = Min(Max(red[i]*scale, 0.0f), 1.0f);
+            f32 g = Min(Max(green[i]*scale, 0.0f), 1.0f);
+            f32 b = Min(Max(blue[i]*scale, 0.0f), 1.0f);
+            
+            u32 ri = (u32)(255.99f * sqrtf(r));
+            u32 gi = (u32)(255.99f * sqrtf(g));
+            u32 bi = (u32)(255.99f * sqrtf(b));
+            pixel[i] = 255u<<24 | bi << 16 | gi << 8 | ri;
+        }
+    }
+    
+    // NOTE(mevex): Converts the linear color of the inclusive rectangle to memory: scale (the inverse
+    //              of the samples count when several passes were summed), clamp to [0, 1], gamma 2
+    //              and pack. The rectangle uses the same y up coordinates as SetPixel. With the tiled
+    //              layout it grows to whole blocks, the padding of the canvas included.
+    void Resolve(i32 minX, i32 minY, i32 maxX, i32 maxY, f32 scale = 1.0f)
+    {
+        if(!hdr)
+            return;
+        
+        if(layout.type == CANVAS_LAYOUT_TILED)
+        {
+            // NOTE(mevex): The blocks of a row of blocks are one after the other
+            i32 firstBlock = minX >> CANVAS_BLOCK_SHIFT;
+            i32 lastBlock = maxX >> CANVAS_BLOCK_SHIFT;
+            size_t count = (size_t)(lastBlock - firstBlock + 1) * CANVAS_BLOCK_SIZE * CANVAS_BLOCK_SIZE;
+            for(i32 y = minY & ~(CANVAS_BLOCK_SIZE - 1); y <= maxY; y += CANVAS_BLOCK_SIZE)
+                ResolveSpan(layout.Offset(firstBlock << CANVAS_BLOCK_SHIFT, y), count, scale);
+        }
+        else
+        {
+            for(i32 y = minY; y <= maxY; ++y)
+                ResolveSpan(layout.Offset(minX, y), (size_t)(maxX - minX + 1), scale);
+        }
+    }
+    
+    void Resolve(f32 scale = 1.0f)
+    {
+        Resolve(0, 0, width - 1, height - 1, scale);
+    }
+    
+    // NOTE(mevex): Copies memory to out in the linear layout, rows top down
+    void Detile(u32 *out)
+    {
+        if(layout.type == CANVAS_LAYOUT_LINEAR)
+        {
+            memcpy(out, memory, sizeof(u32) * pixelsCount);
+            return;
+        }
+        
+        for(i32 y = height - 1; y >= 0; --y)
+        {
+            size_t rowOffset = layout.Row(y);
+            for(i32 x = 0; x < width; x += CANVAS_BLOCK_SIZE)
+            {
+                i32 count = Min(CANVAS_BLOCK_SIZE, width - x);
+                memcpy(out, (u32 *)memory + rowOffset + layout.Column(x), sizeof(u32) * count);
+                out += count;
+            }
+        }
+    }
+    
+    // NOTE(mevex): Start of a frame, nothing of the previous one must survive in either buffer
+    void Clear(Color c)
+    {
+        FillEntireCanvas(c);
+        ClearDepth();
+    }
+    
+    // NOTE(mevex): The benchmark makes a canvas for every run, so the buffers are freed with it.
+    //              A copy would free them twice.
     ~Canvas()
     {
-        // NOTE(mevex): no need to free the memory since the canvas will be destroyed only when the program closes
+        free(memory);
+        free(zBuffer);
+        free(hdr);
     }
+    
+    Canvas(const Canvas &) = delete;
+    Canvas &operator=(const Canvas &) = delete;
+};
+
+enum rasterizer
+{
+    RASTERIZER_SCANLINE,
+    RASTERIZER_EDGE_FUNCTION,
+    RASTERIZER_FIXED_POINT,
+    
+    RASTERIZERS_COUNT
 };
 
+global_variable const char *rasterizerNames[RASTERIZERS_COUNT] = {"scanline", "edge", "fixed"};
+
+#include "stats.h"
 #include "draw.h"
+#include "visibility.h"
+#include "tiles.h"
+#include "imageencoder.h"
+#include "imagewriter.h"
 
 enum clipping
 {
@@ -265,6 +671,120 @@ class Camera
         
         return p3(cx, cy, -point.z);
     }
+    
+    // NOTE(mevex): Signed distance from a clipping plane in homogeneous clip space, where the
+    //              frustum is -w <= x <= w, -w <= y <= w and w >= 1 with w = -z.
+    //              Positive means inside. It is not normalized, but the sign and the ratios
+    //              along an edge are the same as the ones of the camera space planes.
+    //              scale widens the side planes, 2 gives a band as wide as the viewport on each side.
+    inline f32 ClipDistance(p3 point, int plane, f32 scale = 1.0f)
+    {
+        f32 w = -point.z;
+        switch(plane)
+        {
+            case NEAR: return w - 1.0f;
+            case LEFT: return scale*w + point.x * (2.0f / vpWidth);
+            case RIGHT: return scale*w - point.x * (2.0f / vpWidth);
+            case TOP: return scale*w - point.y * (2.0f / vpHeight);
+            case BOTTOM: return scale*w + point.y * (2.0f / vpHeight);
+        }
+        return 0;
+    }
+};
+
+#include "geometry.h"
+#include "bvh.h"
+#include "animation.h"
+#include "occlusion.h"
+
+struct RenderSettings
+{
+    // NOTE(mevex): The scanline rasterizer is kept to compare against the edge function one.
+    //              The fixed point one snaps the vertices to a sub-pixel grid and follows the
+    //              top-left rule, the pixels on the edges shared in a mesh are written only once.
+    int rasterizer = RASTERIZER_EDGE_FUNCTION;
+    
+    // NOTE(mevex): When set, triangles are binned and rasterized by the tile renderer threads.
+    //              It uses the fixed point rasterizer when asked to, the edge function one otherwise.
+    TileRenderer *tiles = NULL;
+    
+    // NOTE(mevex): When set, the rasterizers write only depth and triangle ids, and every visible
+    //              pixel is shaded once at the end of the frame, see visibility.h
+    VisibilityBuffer *visibility = NULL;
+    
+    // NOTE(mevex): When set, instances are frustum culled through the BVH.
+    //              It must be refitted after moving the instances.
+    InstanceBVH *bvh = NULL;
+    
+    // NOTE(mevex): When set, the instances whose bounding sphere is at least occluderRadius pixels
+    //              on screen are drawn first, as occluders. The depth pyramid is built from them and
+    //              every other instance is tested against it before any of its vertices is touched.
+    DepthPyramid *occlusion = NULL;
+    f32 occluderRadius = 64.0f;
+    
+    // NOTE(mevex): Draws the visible instances nearest first, so more of the pixels behind them fail
+    //              the depth test before they are shaded. Within a mesh the triangles keep the order
+    //              of Mesh::OrderTrianglesForOverdraw. With occlusion the occluders still go first.
+    bool sortInstances = false;
+    
+    // NOTE(mevex): Size of the guard band as a multiple of the viewport, 1 disables it.
+    //              Triangles that cross a side plane but stay inside the band are not clipped,
+    //              the rasterizers scissor them to the canvas. The near plane is always clipped.
+    f32 guardBand = 2.0f;
+    
+    // NOTE(mevex): When set, the pipeline counters are collected into it, see stats.h.
+    //              It needs a counters block for every worker of the tile renderer.
+    PipelineStats *stats = NULL;
+    
+    // NOTE(mevex): Fills RenderStats::stageSeconds, off by default because reading the clock costs
+    bool timeStages = false;
+    
+    // NOTE(mevex): With the profiler, records a zone for every stage of every instance. That is a few
+    //              zones per instance, so it is meant for a frame or two, the rings wrap on long runs.
+    bool profileStages = false;
+};
+
+enum render_stage
+{
+    STAGE_CULL,
+    STAGE_SORT,
+    STAGE_TRANSFORM,
+    STAGE_CLIP,
+    STAGE_PROJECT,
+    STAGE_LIGHT,
+    STAGE_RASTER,
+    
+    RENDER_STAGES_COUNT
+};
+
+global_variable const char *stageNames[RENDER_STAGES_COUNT] = {"cull", "sort", "transform", "clip", "project", "light", "raster"};
+
+struct RenderStats
+{
+    // NOTE(mevex): Vertices of the instances that survived the culling, against the ones that
+    //              were actually transformed, projected and lit (the clipping can add a few more)
+    u64 meshVerticesCount;
+    u64 processedVerticesCount;
+    
+    // NOTE(mevex): Triangles sent to the rasterizer, after culling and clipping
+    u64 rasterizedTrianglesCount;
+    
+    // NOTE(mevex): Pixels that passed the depth test, the ones that got a triangle id too
+    u64 pixelsWrittenCount;
+    
+    // NOTE(mevex): The canvas clear and the tile binning count as raster
+    f64 stageSeconds[RENDER_STAGES_COUNT];
+    
+    // NOTE(mevex): Every field is a total, so the stats of several frames simply add up
+    void Add(RenderStats &other)
+    {
+        meshVerticesCount += other.meshVerticesCount;
+        processedVerticesCount += other.processedVerticesCount;
+        rasterizedTrianglesCount += other.rasterizedTrianglesCount;
+        pixelsWrittenCount += other.pixelsWrittenCount;
+        for(int stage = 0; stage < RENDER_STAGES_COUNT; ++stage)
+            stageSeconds[stage] += other.stageSeconds[stage];
+    }
 };
 
 #endif //MAIN_H
@@ -1,6 +1,8 @@
 #ifndef MESH_H
 #define MESH_H
 
+#include <algorithm>
+
 struct Sphere
 {
     p3 center;
@@ -22,15 +24,55 @@ struct Triangle
     Color color;
 };
 
+// NOTE(mevex): Structure of arrays version of a vertex array, used by the SIMD geometry stage.
+//              It does not own the memory, that comes from the mesh or from the frame arena.
+struct VertexStreams
+{
+    f32 *x;
+    f32 *y;
+    f32 *z;
+    size_t count;
+    size_t capacity;
+    
+    inline p3 Get(size_t i)
+    {
+        Assert(i < count);
+        return p3(x[i], y[i], z[i]);
+    }
+    
+    inline size_t Add(p3 p)
+    {
+        Assert(count < capacity);
+        x[count] = p.x;
+        y[count] = p.y;
+        z[count] = p.z;
+        return count++;
+    }
+};
+
 struct Mesh
 {
-    vector<p3> vertices;
+    // NOTE(mevex): The vertices are stored as structure of arrays
+    vector<f32> verticesX;
+    vector<f32> verticesY;
+    vector<f32> verticesZ;
     vector<Triangle> triangles;
+    // NOTE(mevex): Unit normal of each triangle in object space, computed once after loading
+    vector<v3> faceNormals;
     Sphere boundingSphere;
     
+    // NOTE(mevex): When the mesh comes from the binary cache the vectors stay empty
+    //              and the data is read straight from the mapped file
+    bool mapped = false;
+    VertexStreams mappedStreams = {};
+    FixedArray<Triangle> mappedTriangles = {};
+    FixedArray<v3> mappedFaceNormals = {};
+    
     inline void Add(p3 p)
     {
-        vertices.push_back(p);
+        verticesX.push_back(p.x);
+        verticesY.push_back(p.y);
+        verticesZ.push_back(p.z);
     }
     
     inline void Add(Triangle t)
@@ -38,21 +80,68 @@ struct Mesh
         triangles.push_back(t);
     }
     
+    inline VertexStreams Streams()
+    {
+        if(mapped)
+            return mappedStreams;
+        
+        size_t count = verticesX.size();
+        VertexStreams result = {verticesX.data(), verticesY.data(), verticesZ.data(), count, count};
+        return result;
+    }
+    
+    inline FixedArray<Triangle> Triangles()
+    {
+        if(mapped)
+            return mappedTriangles;
+        
+        return ToFixedArray(triangles);
+    }
+    
+    inline FixedArray<v3> FaceNormals()
+    {
+        if(mapped)
+            return mappedFaceNormals;
+        
+        return ToFixedArray(faceNormals);
+    }
+    
+    // NOTE(mevex): Degenerate triangles get a zero normal, so they never face the camera
+    void CalculateFaceNormals()
+    {
+        VertexStreams vertices = Streams();
+        FixedArray<Triangle> tris = Triangles();
+        faceNormals.resize(tris.count);
+        for(int i = 0; i < tris.count; ++i)
+        {
+            p3 a = vertices.Get(tris[i].a);
+            v3 vBA = vertices.Get(tris[i].b) - a;
+            v3 vCA = vertices.Get(tris[i].c) - a;
+            
+            v3 n = Cross(vBA, vCA);
+            f32 length = n.Length();
+            if(length > 0)
+                n *= 1.0f / length;
+            faceNormals[i] = n;
+        }
+    }
+    
     void CalculateBoundingSphere()
     {
-        size_t vCount = vertices.size();
+        VertexStreams vertices = Streams();
+        size_t vCount = vertices.count;
         f32 weight = 1.0f / vCount;
         
         p3 avgP;
         for(int i = 0; i < vCount; ++i)
         {
-            avgP += weight * vertices[i];
+            avgP += weight * vertices.Get(i);
         }
         
         f32 maxDistance = 0;
         for(int i = 0; i < vCount; ++i)
         {
-            f32 distance = Abs((vertices[i] - avgP).LengthSquared());
+            f32 distance = Abs((vertices.Get(i) - avgP).LengthSquared());
             if(maxDistance < distance)
                 maxDistance = distance;
         }
@@ -60,6 +149,43 @@ struct Mesh
         boundingSphere.center = avgP;
         boundingSphere.r = sqrt(maxDistance);
     }
+    
+    // NOTE(mevex): View independent order that cuts the overdraw inside the mesh, after Sander et al.
+    //              "Fast triangle reordering for vertex locality and reduced overdraw" without their
+    //              clustering, the vertices are gathered per instance anyway. The triangles far out
+    //              from the center and facing away from it are the ones most likely to cover the
+    //              rest of the mesh from any side, so they go first. Needs the face normals and the
+    //              bounding sphere, and a mesh that is not mapped.
+    void OrderTrianglesForOverdraw()
+    {
+        Assert(!mapped);
+        VertexStreams vertices = Streams();
+        size_t count = triangles.size();
+        
+        vector<f32> keys(count);
+        vector<u32> order(count);
+        for(size_t i = 0; i < count; ++i)
+        {
+            Triangle &t = triangles[i];
+            p3 centroid = (1.0f/3.0f) * (vertices.Get(t.a) + vertices.Get(t.b) + vertices.Get(t.c));
+            keys[i] = Dot(centroid - boundingSphere.center, faceNormals[i]);
+            order[i] = (u32)i;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](u32 a, u32 b)
+                         {
+                             return keys[a] > keys[b];
+                         });
+        
+        vector<Triangle> sortedTriangles(count);
+        vector<v3> sortedNormals(count);
+        for(size_t i = 0; i < count; ++i)
+        {
+            sortedTriangles[i] = triangles[order[i]];
+            sortedNormals[i] = faceNormals[order[i]];
+        }
+        triangles.swap(sortedTriangles);
+        faceNormals.swap(sortedNormals);
+    }
 };
 
 enum axis
@@ -88,6 +214,23 @@ struct Instance
         rotations[Z] = 0;
         position = p3(0,0,0);
     }
+    
+    // NOTE(mevex): Object to world transform, applied in the following order:
+    //              scale -> rotation -> position;
+    m4x4 Transform()
+    {
+        m4x4 result = Translation(position) * ((ZRotation(rotations[Z]) * YRotation(rotations[Y]) * XRotation(rotations[X])) * Scale(scale));
+        return result;
+    }
+    
+    // NOTE(mevex): Bounding sphere of the mesh moved to world space
+    Sphere WorldBoundingSphere()
+    {
+        Sphere result;
+        result.center = NotHomogeneous(Transform() * HomogeneousPoint(mesh->boundingSphere.center));
+        result.r = mesh->boundingSphere.r * scale;
+        return result;
+    }
 };
 
 #endif //MESH_H
@@ -0,0 +1,202 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+// NOTE(mevex): Binary copy of a loaded mesh, saved next to the obj file so that the next runs
+//              can map it instead of parsing the text again. Layout of the file:
+//              header | x[] | y[] | z[] | triangles[] | faceNormals[]   (every array starts 16 bytes aligned)
+//              The header keeps the size and the modification time of the obj and of the material
+//              libraries it names, and a hash of all their contents. A run that finds the same
+//              sizes and times uses the cache without reading the sources, otherwise the sources
+//              are hashed and the cache is thrown away only when the hash does not match anymore.
+
+#define MESH_CACHE_MAGIC 0x4853454D // "MESH"
+#define MESH_CACHE_VERSION 5
+#define MESH_CACHE_HASH_SEED 0xCBF29CE484222325ull
+#define MESH_CACHE_MAX_LIBRARIES 8
+#define MESH_CACHE_MAX_NAME 256
+
+// NOTE(mevex): What a cache is built from, see HashObjSources. librariesFound has bit i set when
+//              libraries[i] was found in the search paths, its stats are zero otherwise.
+//              Without complete (too many libraries, or a name too long) only the hash is trusted.
+struct MeshCacheSource
+{
+    FileStats obj;
+    u64 hash;
+    u32 complete;
+    u32 librariesCount;
+    u32 librariesFound;
+    char libraries[MESH_CACHE_MAX_LIBRARIES][MESH_CACHE_MAX_NAME];
+    FileStats librariesStats[MESH_CACHE_MAX_LIBRARIES];
+};
+
+struct MeshCacheHeader
+{
+    u32 magic;
+    u32 version;
+    MeshCacheSource source;
+    u64 verticesCount;
+    u64 trianglesCount;
+    Sphere boundingSphere;
+};
+
+// NOTE(mevex): FNV-1a over 8 bytes at a time, then over the bytes left. Only meant to notice that a
+//              file changed, chain the calls to hash several files.
+u64 HashBytes(void *data, size_t size, u64 hash)
+{
+    u64 prime = 0x100000001B3ull;
+    u8 *at = (u8 *)data;
+    size_t i = 0;
+    for(; i + 8 <= size; i += 8)
+    {
+        u64 word;
+        memcpy(&word, at + i, 8);
+        hash = (hash ^ word) * prime;
+    }
+    for(; i < size; ++i)
+        hash = (hash ^ at[i]) * prime;
+    return hash;
+}
+
+inline u64 AlignUp16(u64 value)
+{
+    return (value + 15) & ~(u64)15;
+}
+
+struct MeshCacheLayout
+{
+    u64 xOffset;
+    u64 yOffset;
+    u64 zOffset;
+    u64 trianglesOffset;
+    u64 faceNormalsOffset;
+    u64 fileSize;
+};
+
+MeshCacheLayout GetMeshCacheLayout(u64 verticesCount, u64 trianglesCount)
+{
+    u64 streamSize = AlignUp16(verticesCount * sizeof(f32));
+    
+    MeshCacheLayout result;
+    result.xOffset = AlignUp16(sizeof(MeshCacheHeader));
+    result.yOffset = result.xOffset + streamSize;
+    result.zOffset = result.yOffset + streamSize;
+    result.trianglesOffset = result.zOffset + streamSize;
+    result.faceNormalsOffset = result.trianglesOffset + AlignUp16(trianglesCount * sizeof(Triangle));
+    result.fileSize = result.faceNormalsOffset + trianglesCount * sizeof(v3);
+    return result;
+}
+
+// NOTE(mevex): Maps a cache written by this version, whatever its sources. Returns its header,
+//              NULL when there is no such cache.
+MeshCacheHeader *MapMeshCache(MappedFile &file, const char *cachePath)
+{
+    if(!MapFile(file, cachePath))
+        return NULL;
+    
+    MeshCacheHeader *header = (MeshCacheHeader *)file.memory;
+    bool valid = (file.size >= sizeof(MeshCacheHeader) &&
+                  header->magic == MESH_CACHE_MAGIC &&
+                  header->version == MESH_CACHE_VERSION);
+    if(valid)
+    {
+        MeshCacheLayout layout = GetMeshCacheLayout(header->verticesCount, header->trianglesCount);
+        valid = (file.size >= layout.fileSize);
+    }
+    
+    if(!valid)
+    {
+        UnmapFile(file);
+        return NULL;
+    }
+    
+    return header;
+}
+
+// NOTE(mevex): The mesh points straight into the mapping from MapMeshCache, nothing is copied.
+//              The file stays mapped for as long as the program runs.
+void LoadMeshCache(Mesh *mesh, MappedFile &file)
+{
+    MeshCacheHeader *header = (MeshCacheHeader *)file.memory;
+    MeshCacheLayout layout = GetMeshCacheLayout(header->verticesCount, header->trianglesCount);
+    u8 *base = (u8 *)file.memory;
+    size_t verticesCount = (size_t)header->verticesCount;
+    size_t trianglesCount = (size_t)header->trianglesCount;
+    
+    mesh->mapped = true;
+    mesh->mappedStreams.x = (f32 *)(base + layout.xOffset);
+    mesh->mappedStreams.y = (f32 *)(base + layout.yOffset);
+    mesh->mappedStreams.z = (f32 *)(base + layout.zOffset);
+    mesh->mappedStreams.count = verticesCount;
+    mesh->mappedStreams.capacity = verticesCount;
+    mesh->mappedTriangles.e = (Triangle *)(base + layout.trianglesOffset);
+    mesh->mappedTriangles.count = trianglesCount;
+    mesh->mappedTriangles.capacity = trianglesCount;
+    mesh->mappedFaceNormals.e = (v3 *)(base + layout.faceNormalsOffset);
+    mesh->mappedFaceNormals.count = trianglesCount;
+    mesh->mappedFaceNormals.capacity = trianglesCount;
+    mesh->boundingSphere = header->boundingSphere;
+}
+
+// NOTE(mevex): Stores new stats for sources that were touched but hash the same, so that the
+//              next runs do not hash them again. Writing through the file keeps the mapping valid.
+bool UpdateMeshCacheSource(const char *cachePath, MeshCacheSource &source)
+{
+    FILE *file = OpenFile(cachePath, "r+b");
+    if(!file)
+        return false;
+    
+    bool ok = (fseek(file, (long)offsetof(MeshCacheHeader, source), SEEK_SET) == 0);
+    ok = ok && (fwrite(&source, sizeof(source), 1, file) == 1);
+    ok = (fclose(file) == 0) && ok;
+    return ok;
+}
+
+bool WriteMeshCache(Mesh *mesh, const char *cachePath, MeshCacheSource &source)
+{
+    VertexStreams streams = mesh->Streams();
+    FixedArray<Triangle> triangles = mesh->Triangles();
+    FixedArray<v3> faceNormals = mesh->FaceNormals();
+    Assert(faceNormals.count == triangles.count);
+    
+    MeshCacheHeader header = {};
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.source = source;
+    header.verticesCount = streams.count;
+    header.trianglesCount = triangles.count;
+    header.boundingSphere = mesh->boundingSphere;
+    
+    MeshCacheLayout layout = GetMeshCacheLayout(header.verticesCount, header.trianglesCount);
+    
+    FILE *file = OpenFile(cachePath, "wb");
+    if(!file)
+        return false;
+    
+    u8 padding[16] = {};
+    u64 streamBytes = streams.count * sizeof(f32);
+    size_t streamPadding = (size_t)(AlignUp16(streamBytes) - streamBytes);
+    size_t headerPadding = (size_t)(layout.xOffset - sizeof(MeshCacheHeader));
+    u64 trianglesBytes = triangles.count * sizeof(Triangle);
+    size_t trianglesPadding = (size_t)(AlignUp16(trianglesBytes) - trianglesBytes);
+    
+    bool ok = (fwrite(&header, sizeof(header), 1, file) == 1);
+    ok = ok && (fwrite(padding, 1, headerPadding, file) == headerPadding);
+    f32 *arrays[3] = {streams.x, streams.y, streams.z};
+    for(int i = 0; i < 3; ++i)
+    {
+        ok = ok && (fwrite(arrays[i], sizeof(f32), streams.count, file) == streams.count);
+        ok = ok && (fwrite(padding, 1, streamPadding, file) == streamPadding);
+    }
+    ok = ok && (fwrite(triangles.e, sizeof(Triangle), triangles.count, file) == triangles.count);
+    ok = ok && (fwrite(padding, 1, trianglesPadding, file) == trianglesPadding);
+    ok = ok && (fwrite(faceNormals.e, sizeof(v3), faceNormals.count, file) == faceNormals.count);
+    ok = (fclose(file) == 0) && ok;
+    
+    // NOTE(mevex): Never leave a truncated cache behind
+    if(!ok)
+        remove(cachePath);
+    
+    return ok;
+}
+
+#endif //MESHCACHE_H
@@ -0,0 +1,566 @@
+#ifndef OBJLOADER_H
+#define OBJLOADER_H
+
+// NOTE(mevex): Native obj parser. The file is memory mapped and split into chunks at line
+//              boundaries, then parsed in two parallel passes:
+//              1) every chunk counts its vertices and triangles and remembers its materials
+//              2) with the prefix sums of the counts each chunk knows where its output goes,
+//                 so it writes vertices and triangles straight into the Mesh storage.
+//              Only positions and faces are read, faces with more than three vertices are
+//              triangulated as fans and all the objects/groups of the file end up in the mesh.
+
+#include <map>
+#include <string>
+
+struct ObjChunk
+{
+    char *begin;
+    char *end;
+    
+    // NOTE(mevex): Filled by the first pass
+    size_t verticesCount;
+    size_t trianglesCount;
+    char *lastMaterial; // name of the last usemtl of the chunk, points into the file
+    vector<std::string> materialLibraries;
+    
+    // NOTE(mevex): Filled between the passes
+    size_t firstVertex;
+    size_t firstTriangle;
+    Color startColor;
+    
+    bool failed;
+};
+
+struct ObjParseJob
+{
+    ObjChunk *chunks;
+    int chunksCount;
+    std::atomic<int> nextChunk;
+    int pass;
+    
+    size_t totalVerticesCount;
+    f32 *x;
+    f32 *y;
+    f32 *z;
+    Triangle *triangles;
+    std::map<std::string, int> *materialMap;
+    vector<Color> *colors;
+};
+
+// NOTE(mevex): Faces without a material get this color
+#define OBJ_DEFAULT_COLOR Color(0.8f, 0.8f, 0.8f)
+
+inline bool IsObjSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline bool IsObjDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+inline void SkipObjSpaces(char *&at, char *end)
+{
+    while(at < end && IsObjSpace(*at))
+        ++at;
+}
+
+inline void SkipObjLine(char *&at, char *end)
+{
+    while(at < end && *at != '\n')
+        ++at;
+    if(at < end)
+        ++at;
+}
+
+// NOTE(mevex): Compares the keyword at the beginning of a line, it must be followed by a space
+inline bool IsObjKeyword(char *at, char *end, const char *keyword)
+{
+    while(*keyword)
+    {
+        if(at >= end || *at != *keyword)
+            return false;
+        ++at;
+        ++keyword;
+    }
+    return at < end && IsObjSpace(*at);
+}
+
+inline std::string ReadObjName(char *at, char *end)
+{
+    SkipObjSpaces(at, end);
+    char *nameEnd = at;
+    while(nameEnd < end && *nameEnd != '\n' && *nameEnd != '\r')
+        ++nameEnd;
+    while(nameEnd > at && IsObjSpace(nameEnd[-1]))
+        --nameEnd;
+    return std::string(at, nameEnd);
+}
+
+f32 ParseObjFloat(char *&at, char *end)
+{
+    local_persist const f64 powersOf10[] =
+    {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    
+    SkipObjSpaces(at, end);
+    
+    bool negative = false;
+    if(at < end && (*at == '-' || *at == '+'))
+    {
+        negative = (*at == '-');
+        ++at;
+    }
+    
+    // NOTE(mevex): Keep up to 19 significant digits in an integer and track the decimal exponent
+    u64 mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    while(at < end && IsObjDigit(*at))
+    {
+        if(digits < 19)
+        {
+            mantissa = mantissa*10 + (*at - '0');
+            if(mantissa)
+                ++digits;
+        }
+        else
+        {
+            ++exponent;
+        }
+        ++at;
+    }
+    
+    if(at < end && *at == '.')
+    {
+        ++at;
+        while(at < end && IsObjDigit(*at))
+        {
+            if(digits < 19)
+            {
+                mantissa = mantissa*10 + (*at - '0');
+                if(mantissa)
+                    ++digits;
+                --exponent;
+            }
+            ++at;
+        }
+    }
+    
+    if(at < end && (*at == 'e' || *at == 'E'))
+    {
+        ++at;
+        bool negativeExponent = false;
+        if(at < end && (*at == '-' || *at == '+'))
+        {
+            negativeExponent = (*at == '-');
+            ++at;
+        }
+        
+        int e = 0;
+        while(at < end && IsObjDigit(*at))
+        {
+            if(e < 10000)
+                e = e*10 + (*at - '0');
+            ++at;
+        }
+        exponent += negativeExponent ? -e : e;
+    }
+    
+    f64 value = (f64)mantissa;
+    if(exponent < 0)
+        value /= (exponent >= -22) ? powersOf10[-exponent] : pow(10.0, -exponent);
+    else if(exponent > 0)
+        value *= (exponent <= 22) ? powersOf10[exponent] : pow(10.0, exponent);
+    
+    return (f32)(negative ? -value : value);
+}
+
+// NOTE(mevex): Reads the vertex index of a face corner (v, v/vt, v//vn or v/vt/vn).
+//              Returns false at the end of the line.
+inline bool ParseObjFaceIndex(char *&at, char *end, i64 &index)
+{
+    SkipObjSpaces(at, end);
+    if(at >= end || *at == '\n' || *at == '#')
+        return false;
+    
+    bool negative = false;
+    if(*at == '-' || *at == '+')
+    {
+        negative = (*at == '-');
+        ++at;
+    }
+    
+    index = 0;
+    while(at < end && IsObjDigit(*at))
+    {
+        index = index*10 + (*at - '0');
+        ++at;
+    }
+    if(negative)
+        index = -index;
+    
+    // NOTE(mevex): Skip the texture and normal indices
+    while(at < end && !IsObjSpace(*at) && *at != '\n')
+        ++at;
+    
+    return true;
+}
+
+void ParseObjChunkCounts(ObjChunk &chunk)
+{
+    char *at = chunk.begin;
+    char *end = chunk.end;
+    
+    while(at < end)
+    {
+        SkipObjSpaces(at, end);
+        
+        if(IsObjKeyword(at, end, "v"))
+        {
+            ++chunk.verticesCount;
+        }
+        else if(IsObjKeyword(at, end, "f"))
+        {
+            at += 1;
+            i64 index;
+            int corners = 0;
+            while(ParseObjFaceIndex(at, end, index))
+                ++corners;
+            
+            if(corners >= 3)
+                chunk.trianglesCount += corners - 2;
+        }
+        else if(IsObjKeyword(at, end, "usemtl"))
+        {
+            chunk.lastMaterial = at + 6;
+        }
+        else if(IsObjKeyword(at, end, "mtllib"))
+        {
+            chunk.materialLibraries.push_back(ReadObjName(at + 6, end));
+        }
+        
+        SkipObjLine(at, end);
+    }
+}
+
+inline Color LookupObjMaterial(ObjParseJob &job, const std::string &name)
+{
+    auto found = job.materialMap->find(name);
+    if(found == job.materialMap->end())
+        return OBJ_DEFAULT_COLOR;
+    return (*job.colors)[found->second];
+}
+
+void ParseObjChunkData(ObjParseJob &job, ObjChunk &chunk)
+{
+    char *at = chunk.begin;
+    char *end = chunk.end;
+    
+    size_t vertexIndex = chunk.firstVertex;
+    size_t triangleIndex = chunk.firstTriangle;
+    Color color = chunk.startColor;
+    
+    while(at < end)
+    {
+        SkipObjSpaces(at, end);
+        
+        if(IsObjKeyword(at, end, "v"))
+        {
+            at += 1;
+            job.x[vertexIndex] = ParseObjFloat(at, end);
+            job.y[vertexIndex] = ParseObjFloat(at, end);
+            job.z[vertexIndex] = ParseObjFloat(at, end);
+            ++vertexIndex;
+        }
+        else if(IsObjKeyword(at, end, "f"))
+        {
+            at += 1;
+            
+            // NOTE(mevex): Fan triangulation: (first, previous, current)
+            int indices[3];
+            int corners = 0;
+            i64 index;
+            while(ParseObjFaceIndex(at, end, index))
+            {
+                // NOTE(mevex): Indices start at 1, negative ones are relative to the last vertex read
+                i64 absolute = (index < 0) ? (i64)vertexIndex + index : index - 1;
+                if(absolute < 0 || absolute >= (i64)job.totalVerticesCount)
+                {
+                    chunk.failed = true;
+                    absolute = 0;
+                }
+                
+                if(corners < 2)
+                {
+                    indices[corners] = (int)absolute;
+                }
+                else
+                {
+                    indices[2] = (int)absolute;
+                    Triangle t = {indices[0], indices[1], indices[2], color};
+                    job.triangles[triangleIndex++] = t;
+                    indices[1] = indices[2];
+                }
+                ++corners;
+            }
+        }
+        else if(IsObjKeyword(at, end, "usemtl"))
+        {
+            color = LookupObjMaterial(job, ReadObjName(at + 6, end));
+        }
+        
+        SkipObjLine(at, end);
+    }
+}
+
+shared_function void ParseObjWork(void *data, int workerIndex)
+{
+    ObjParseJob *job = (ObjParseJob *)data;
+    
+    while(true)
+    {
+        int chunkIndex = job->nextChunk.fetch_add(1, std::memory_order_relaxed);
+        if(chunkIndex >= job->chunksCount)
+            break;
+        
+        TIMED_ZONE("ParseObjChunk");
+        ObjChunk &chunk = job->chunks[chunkIndex];
+        if(job->pass == 0)
+            ParseObjChunkCounts(chunk);
+        else
+            ParseObjChunkData(*job, chunk);
+    }
+}
+
+bool ParseObj(Mesh *mesh, const char *filename, const char *basepath, WorkerPool &pool, std::string &warn, std::string &err)
+{
+    MappedFile file;
+    if(!MapFile(file, filename))
+    {
+        err += "Cannot open " + std::string(filename) + "\n";
+        return false;
+    }
+    
+    // NOTE(mevex): A few chunks per worker so that the atomic counter can balance the load
+    char *fileBegin = (char *)file.memory;
+    char *fileEnd = fileBegin + file.size;
+    size_t minChunkSize = 256*1024;
+    size_t chunksCount = Min(file.size / minChunkSize + 1, (size_t)pool.workersCount * 8);
+    
+    vector<ObjChunk> chunks(chunksCount);
+    char *chunkBegin = fileBegin;
+    for(size_t i = 0; i < chunksCount; ++i)
+    {
+        char *chunkEnd = (i == chunksCount - 1) ? fileEnd : fileBegin + file.size * (i + 1) / chunksCount;
+        if(chunkEnd < chunkBegin)
+            chunkEnd = chunkBegin;
+        SkipObjLine(chunkEnd, fileEnd);
+        
+        ObjChunk &chunk = chunks[i];
+        chunk.begin = chunkBegin;
+        chunk.end = chunkEnd;
+        chunk.verticesCount = 0;
+        chunk.trianglesCount = 0;
+        chunk.lastMaterial = NULL;
+        chunk.failed = false;
+        chunkBegin = chunkEnd;
+    }
+    
+    ObjParseJob job;
+    job.chunks = chunks.data();
+    job.chunksCount = (int)chunksCount;
+    job.nextChunk = 0;
+    job.pass = 0;
+    pool.Run(ParseObjWork, &job);
+    
+    // NOTE(mevex): Load the materials in file order
+    std::map<std::string, int> materialMap;
+    vector<tinyobj::material_t> materials;
+    tinyobj::MaterialFileReader materialReader(basepath ? basepath : "");
+    for(ObjChunk &chunk : chunks)
+    {
+        for(std::string &library : chunk.materialLibraries)
+            materialReader(library, &materials, &materialMap, &warn, &err);
+    }
+    
+    vector<Color> colors;
+    for(tinyobj::material_t &m : materials)
+        colors.push_back(Color(m.diffuse[0], m.diffuse[1], m.diffuse[2]));
+    
+    job.materialMap = &materialMap;
+    job.colors = &colors;
+    
+    // NOTE(mevex): Prefix sums of the counts and the material active at the start of every chunk
+    size_t verticesCount = 0;
+    size_t trianglesCount = 0;
+    Color color = OBJ_DEFAULT_COLOR;
+    for(ObjChunk &chunk : chunks)
+    {
+        chunk.firstVertex = verticesCount;
+        chunk.firstTriangle = trianglesCount;
+        chunk.startColor = color;
+        
+        verticesCount += chunk.verticesCount;
+        trianglesCount += chunk.trianglesCount;
+        if(chunk.lastMaterial)
+            color = LookupObjMaterial(job, ReadObjName(chunk.lastMaterial, chunk.end));
+    }
+    
+    mesh->verticesX.resize(verticesCount);
+    mesh->verticesY.resize(verticesCount);
+    mesh->verticesZ.resize(verticesCount);
+    mesh->triangles.resize(trianglesCount);
+    
+    job.totalVerticesCount = verticesCount;
+    job.x = mesh->verticesX.data();
+    job.y = mesh->verticesY.data();
+    job.z = mesh->verticesZ.data();
+    job.triangles = mesh->triangles.data();
+    job.nextChunk = 0;
+    job.pass = 1;
+    pool.Run(ParseObjWork, &job);
+    
+    UnmapFile(file);
+    
+    bool failed = false;
+    for(ObjChunk &chunk : chunks)
+        failed = failed || chunk.failed;
+    
+    if(failed)
+    {
+        err += "Face with a vertex index out of range in " + std::string(filename) + "\n";
+        return false;
+    }
+    
+    return true;
+}
+
+// NOTE(mevex): Same search paths as tinyobj::MaterialFileReader
+vector<std::string> GetMaterialSearchPaths(const char *basepath)
+{
+#if defined(_WIN32)
+    char separator = ';';
+#else
+    char separator = ':';
+#endif
+    vector<std::string> result;
+    std::string paths = basepath ? basepath : "";
+    size_t begin = 0;
+    while(begin <= paths.size())
+    {
+        size_t next = paths.find(separator, begin);
+        if(next == std::string::npos)
+            next = paths.size();
+        result.push_back(paths.substr(begin, next - begin));
+        begin = next + 1;
+    }
+    return result;
+}
+
+// NOTE(mevex): The first of the search paths where the library exists, like ParseObj looks for it
+bool FindMaterialLibrary(vector<std::string> &searchPaths, const char *library, std::string &path, FileStats &stats)
+{
+    for(std::string &searchPath : searchPaths)
+    {
+        path = tinyobj::JoinPath(searchPath, library);
+        if(GetFileStats(path.c_str(), stats))
+            return true;
+    }
+    return false;
+}
+
+// NOTE(mevex): Key of the mesh cache: the stats of the obj and of the material libraries it names,
+//              looked up in basepath like ParseObj does, and a hash of all their contents. The name
+//              of a library that cannot be opened is hashed, so it counts once it shows up.
+bool HashObjSources(const char *filename, const char *basepath, MeshCacheSource &source)
+{
+    memset(&source, 0, sizeof(source));
+    if(!GetFileStats(filename, source.obj))
+        return false;
+    
+    MappedFile file;
+    if(!MapFile(file, filename))
+        return false;
+    
+    char *at = (char *)file.memory;
+    char *end = at + file.size;
+    source.hash = HashBytes(file.memory, file.size, MESH_CACHE_HASH_SEED);
+    source.complete = 1;
+    
+    vector<std::string> searchPaths = GetMaterialSearchPaths(basepath);
+    while(at < end)
+    {
+        SkipObjSpaces(at, end);
+        if(IsObjKeyword(at, end, "mtllib"))
+        {
+            std::string library = ReadObjName(at + 6, end);
+            source.hash = HashBytes((void *)library.data(), library.size(), source.hash);
+            
+            std::string path;
+            FileStats stats = {};
+            bool found = FindMaterialLibrary(searchPaths, library.c_str(), path, stats);
+            MappedFile materials;
+            if(found && MapFile(materials, path.c_str()))
+            {
+                source.hash = HashBytes(materials.memory, materials.size, source.hash);
+                UnmapFile(materials);
+            }
+            
+            u32 index = source.librariesCount;
+            if(index < MESH_CACHE_MAX_LIBRARIES && library.size() < MESH_CACHE_MAX_NAME)
+            {
+                memcpy(source.libraries[index], library.c_str(), library.size() + 1);
+                if(found)
+                {
+                    source.librariesFound |= 1u << index;
+                    source.librariesStats[index] = stats;
+                }
+                ++source.librariesCount;
+            }
+            else
+            {
+                source.complete = 0;
+            }
+        }
+        SkipObjLine(at, end);
+    }
+    
+    UnmapFile(file);
+    return true;
+}
+
+inline bool SameFileStats(FileStats &a, FileStats &b)
+{
+    bool result = (a.size == b.size && a.modifiedTime == b.modifiedTime);
+    return result;
+}
+
+// NOTE(mevex): True when the obj and its libraries have the stats stored by HashObjSources, checked
+//              without reading them. An edit that keeps both the size and the time goes unnoticed.
+bool ObjSourcesUnchanged(const char *filename, const char *basepath, MeshCacheSource &stored)
+{
+    if(!stored.complete)
+        return false;
+    
+    FileStats stats;
+    if(!GetFileStats(filename, stats) || !SameFileStats(stats, stored.obj))
+        return false;
+    
+    vector<std::string> searchPaths = GetMaterialSearchPaths(basepath);
+    for(u32 i = 0; i < stored.librariesCount && i < MESH_CACHE_MAX_LIBRARIES; ++i)
+    {
+        std::string path;
+        bool found = FindMaterialLibrary(searchPaths, stored.libraries[i], path, stats);
+        bool wasFound = (stored.librariesFound & (1u << i)) != 0;
+        if(found != wasFound || (found && !SameFileStats(stats, stored.librariesStats[i])))
+            return false;
+    }
+    
+    return true;
+}
+
+#endif //OBJLOADER_H
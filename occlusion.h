@@ -0,0 +1,198 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+// NOTE(mevex): Hierarchical depth for the occlusion culling of the instances. Level 0 has a texel
+//              for every 8x8 pixels of the canvas and keeps the farthest depth drawn in them, so the
+//              least reverse depth (0 where a pixel is still clear). Every next level halves the
+//              size and keeps the least of its 2x2 texels. An instance whose nearest point is
+//              behind every texel under its screen bounds cannot pass a single depth test.
+//              It is built from Canvas::zBuffer after the occluders have been drawn, see Render.
+
+#define DEPTH_PYRAMID_TEXEL_SHIFT 3
+#define DEPTH_PYRAMID_MAX_LEVELS 16
+
+// NOTE(mevex): Least depth of a run of count pixels that are next to each other in the buffer.
+//              The unorm values are rounded to the nearest step, so the depth they come from
+//              can be half a step less than the value.
+template <int format>
+inline f32 FarthestDepth(void *buffer, size_t offset, i32 count)
+{
+    if constexpr(format == DEPTH_FORMAT_FLOAT32)
+    {
+        f32 *z = (f32 *)buffer + offset;
+        f32 result = z[0];
+        for(i32 i = 1; i < count; ++i)
+            result = Min(result, z[i]);
+        return result;
+    }
+    else if constexpr(format == DEPTH_FORMAT_UNORM16)
+    {
+        u16 *z = (u16 *)buffer + offset;
+        u16 result = z[0];
+        for(i32 i = 1; i < count; ++i)
+            result = Min(result, z[i]);
+        return result ? ((f32)result - 0.5f) * (1.0f / 65535.0f) : 0.0f;
+    }
+    else
+    {
+        u32 *z = (u32 *)buffer + offset;
+        u32 result = z[0];
+        for(i32 i = 1; i < count; ++i)
+            result = Min(result, z[i]);
+        return result ? ((f32)result - 0.5f) * (1.0f / 16777215.0f) : 0.0f;
+    }
+}
+
+class DepthPyramid
+{
+    public:
+    
+    i32 levelsCount = 0;
+    i32 widths[DEPTH_PYRAMID_MAX_LEVELS];
+    i32 heights[DEPTH_PYRAMID_MAX_LEVELS];
+    size_t offsets[DEPTH_PYRAMID_MAX_LEVELS];
+    vector<f32> texels;
+    
+    i32 canvasWidth = 0;
+    i32 canvasHeight = 0;
+    
+    void Resize(i32 width, i32 height)
+    {
+        canvasWidth = width;
+        canvasHeight = height;
+        
+        i32 texelSize = 1 << DEPTH_PYRAMID_TEXEL_SHIFT;
+        i32 w = (width + texelSize - 1) / texelSize;
+        i32 h = (height + texelSize - 1) / texelSize;
+        size_t total = 0;
+        levelsCount = 0;
+        while(levelsCount < DEPTH_PYRAMID_MAX_LEVELS)
+        {
+            widths[levelsCount] = w;
+            heights[levelsCount] = h;
+            offsets[levelsCount] = total;
+            total += (size_t)w * h;
+            ++levelsCount;
+            
+            if(w == 1 && h == 1)
+                break;
+            w = (w + 1) / 2;
+            h = (h + 1) / 2;
+        }
+        texels.resize(total);
+    }
+    
+    template <int format>
+    void BuildBase(Canvas &canvas)
+    {
+        i32 texelSize = 1 << DEPTH_PYRAMID_TEXEL_SHIFT;
+        f32 *base = texels.data();
+        std::fill(base, base + (size_t)widths[0] * heights[0], 1.0f);
+        
+        // NOTE(mevex): A row of a texel is contiguous in both layouts
+        PixelLayout layout = canvas.layout;
+        for(i32 y = 0; y < canvas.height; ++y)
+        {
+            size_t rowOffset = layout.Row(y);
+            f32 *texel = base + (size_t)(y >> DEPTH_PYRAMID_TEXEL_SHIFT) * widths[0];
+            for(i32 x = 0; x < canvas.width; x += texelSize, ++texel)
+            {
+                i32 count = Min(texelSize, canvas.width - x);
+                f32 depth = FarthestDepth<format>(canvas.zBuffer, rowOffset + layout.Column(x), count);
+                *texel = Min(*texel, depth);
+            }
+        }
+    }
+    
+    void Build(Canvas &canvas)
+    {
+        TIMED_FUNCTION();
+        
+        if(canvas.width != canvasWidth || canvas.height != canvasHeight)
+            Resize(canvas.width, canvas.height);
+        
+        switch(canvas.depthFormat)
+        {
+            case DEPTH_FORMAT_UNORM16: BuildBase<DEPTH_FORMAT_UNORM16>(canvas); break;
+            case DEPTH_FORMAT_UNORM24: BuildBase<DEPTH_FORMAT_UNORM24>(canvas); break;
+            default: BuildBase<DEPTH_FORMAT_FLOAT32>(canvas); break;
+        }
+        
+        // NOTE(mevex): An odd last row or column has a single texel under it
+        for(i32 level = 1; level < levelsCount; ++level)
+        {
+            f32 *below = texels.data() + offsets[level - 1];
+            f32 *current = texels.data() + offsets[level];
+            i32 belowWidth = widths[level - 1];
+            i32 belowHeight = heights[level - 1];
+            for(i32 y = 0; y < heights[level]; ++y)
+            {
+                i32 y0 = 2*y;
+                i32 y1 = Min(y0 + 1, belowHeight - 1);
+                for(i32 x = 0; x < widths[level]; ++x)
+                {
+                    i32 x0 = 2*x;
+                    i32 x1 = Min(x0 + 1, belowWidth - 1);
+                    f32 top = Min(below[y0*belowWidth + x0], below[y0*belowWidth + x1]);
+                    f32 bottom = Min(below[y1*belowWidth + x0], below[y1*belowWidth + x1]);
+                    current[y*widths[level] + x] = Min(top, bottom);
+                }
+            }
+        }
+    }
+    
+    // NOTE(mevex): s is in camera space. The screen bounds are the ones of the box around the
+    //              sphere, and its nearest point is taken as the depth of all of it.
+    //              A sphere that reaches in front of the near plane is never occluded.
+    bool Occluded(Sphere s, Camera &cam)
+    {
+        f32 nearW = -s.center.z - s.r;
+        f32 farW = -s.center.z + s.r;
+        if(nearW < 1.0f)
+            return false;
+        
+        f32 left = s.center.x - s.r;
+        f32 right = s.center.x + s.r;
+        f32 bottom = s.center.y - s.r;
+        f32 top = s.center.y + s.r;
+        
+        f32 scaleX = canvasWidth / cam.vpWidth;
+        f32 scaleY = canvasHeight / cam.vpHeight;
+        f32 minXf = (left / (left < 0 ? nearW : farW)) * scaleX + 0.5f*canvasWidth;
+        f32 maxXf = (right / (right > 0 ? nearW : farW)) * scaleX + 0.5f*canvasWidth;
+        f32 minYf = (bottom / (bottom < 0 ? nearW : farW)) * scaleY + 0.5f*canvasHeight;
+        f32 maxYf = (top / (top > 0 ? nearW : farW)) * scaleY + 0.5f*canvasHeight;
+        
+        // NOTE(mevex): floor and ceil instead of the pixel centers, a pixel more costs nothing
+        i32 minX = Max((i32)floor(minXf), 0);
+        i32 maxX = Min((i32)ceil(maxXf), canvasWidth - 1);
+        i32 minY = Max((i32)floor(minYf), 0);
+        i32 maxY = Min((i32)ceil(maxYf), canvasHeight - 1);
+        if(minX > maxX || minY > maxY)
+            return false;
+        
+        // NOTE(mevex): The first level where the bounds span at most 2x2 texels
+        // NOTE(mevex): Max has no outer parentheses, a + 1 after it would land in one branch only
+        i32 spanX = maxX - minX + 1;
+        i32 spanY = maxY - minY + 1;
+        i32 extent = Max(spanX, spanY);
+        i32 level = 0;
+        while(level + 1 < levelsCount && (1 << (DEPTH_PYRAMID_TEXEL_SHIFT + level)) < extent)
+            ++level;
+        
+        i32 shift = DEPTH_PYRAMID_TEXEL_SHIFT + level;
+        f32 *levelTexels = texels.data() + offsets[level];
+        f32 nearDepth = 1.0f / nearW;
+        for(i32 y = minY >> shift; y <= maxY >> shift; ++y)
+        {
+            for(i32 x = minX >> shift; x <= maxX >> shift; ++x)
+            {
+                if(levelTexels[y*widths[level] + x] <= nearDepth)
+                    return false;
+            }
+        }
+        return true;
+    }
+};
+
+#endif //OCCLUSION_H
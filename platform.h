@@ -0,0 +1,136 @@
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+// NOTE(mevex): The few OS services we need that the standard library does not cover
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#define NOGDI
+#include <windows.h>
+// NOTE(mevex): windows.h defines these as empty macros and they would eat our own names
+#undef NEAR
+#undef FAR
+#undef near
+#undef far
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <stdio.h>
+
+// NOTE(mevex): fopen is deprecated on MSVC and we compile with warnings as errors
+FILE *OpenFile(const char *filename, const char *mode)
+{
+    FILE *result = NULL;
+#if defined(_MSC_VER)
+    if(fopen_s(&result, filename, mode) != 0)
+        result = NULL;
+#else
+    result = fopen(filename, mode);
+#endif
+    return result;
+}
+
+struct MappedFile
+{
+    void *memory;
+    size_t size;
+};
+
+// NOTE(mevex): Maps the whole file read only. The mapping stays valid after the file is closed.
+bool MapFile(MappedFile &file, const char *filename)
+{
+    file.memory = NULL;
+    file.size = 0;
+
+#if defined(_WIN32)
+    HANDLE handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(handle == INVALID_HANDLE_VALUE)
+        return false;
+    
+    LARGE_INTEGER size;
+    if(GetFileSizeEx(handle, &size) && size.QuadPart > 0)
+    {
+        HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+        if(mapping)
+        {
+            file.memory = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            file.size = (size_t)size.QuadPart;
+            CloseHandle(mapping);
+        }
+    }
+    CloseHandle(handle);
+#else
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0)
+        return false;
+    
+    struct stat info;
+    if(fstat(fd, &info) == 0 && info.st_size > 0)
+    {
+        void *memory = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(memory != MAP_FAILED)
+        {
+            file.memory = memory;
+            file.size = (size_t)info.st_size;
+        }
+    }
+    close(fd);
+#endif
+
+    return file.memory != NULL;
+}
+
+void UnmapFile(MappedFile &file)
+{
+    if(!file.memory)
+        return;
+
+#if defined(_WIN32)
+    UnmapViewOfFile(file.memory);
+#else
+    munmap(file.memory, file.size);
+#endif
+
+    file.memory = NULL;
+    file.size = 0;
+}
+
+// NOTE(mevex): modifiedTime is in the finest unit the OS keeps: 100 ns ticks on Windows,
+//              nanoseconds elsewhere. Only meant to be compared with another value from here.
+struct FileStats
+{
+    u64 size;
+    i64 modifiedTime;
+};
+
+bool GetFileStats(const char *filename, FileStats &stats)
+{
+#if defined(_WIN32)
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if(!GetFileAttributesExA(filename, GetFileExInfoStandard, &data))
+        return false;
+    
+    stats.size = ((u64)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    stats.modifiedTime = (i64)(((u64)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime);
+#else
+    struct stat info;
+    if(stat(filename, &info) != 0)
+        return false;
+    
+    stats.size = (u64)info.st_size;
+#if defined(__APPLE__)
+    stats.modifiedTime = (i64)info.st_mtimespec.tv_sec * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+    stats.modifiedTime = (i64)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+#endif
+
+    return true;
+}
+
+#endif //PLATFORM_H
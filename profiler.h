@@ -0,0 +1,192 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// NOTE(mevex): Scoped zone profiler. Build with PROFILER=1 and every TIMED_ZONE / TIMED_FUNCTION
+//              records its begin and end time in a ring buffer owned by the thread that runs it,
+//              so recording takes no lock. WriteProfilerTrace dumps the rings as a Chrome trace
+//              (chrome://tracing or ui.perfetto.dev). Every thread keeps its first PROFILER_KEPT_SIZE
+//              zones for good, they hold the startup (LoadObj), and the last ones in a ring after them.
+//              Without PROFILER the macros expand to nothing.
+//              Zones go on frames, flushes and batches of work, never on a single triangle or tile:
+//              the clock reads would cost more than the work and the ring would wrap within a frame.
+//              The per instance stages are zones only with RenderSettings::profileStages.
+
+#ifndef PROFILER
+#define PROFILER 0
+#endif
+
+#include <chrono>
+
+inline u64 ProfilerTicks(std::chrono::steady_clock::time_point t)
+{
+    u64 result = (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+    return result;
+}
+
+#if PROFILER
+
+#include <mutex>
+
+#ifndef PROFILER_RING_SIZE
+#define PROFILER_RING_SIZE (1 << 14)
+#endif
+#define PROFILER_KEPT_SIZE 256
+
+struct ProfileEvent
+{
+    const char *name;
+    u64 begin;
+    u64 end;
+};
+
+struct ProfilerThread
+{
+    u32 id;
+    // NOTE(mevex): Every zone ever recorded. The first PROFILER_KEPT_SIZE events are never
+    //              overwritten, the ring is the rest of the array.
+    u64 eventsCount;
+    ProfileEvent events[PROFILER_RING_SIZE];
+};
+
+inline ProfileEvent &GetProfileEvent(ProfilerThread *thread, u64 index)
+{
+    u64 slot = index;
+    if(index >= PROFILER_KEPT_SIZE)
+        slot = PROFILER_KEPT_SIZE + (index - PROFILER_KEPT_SIZE) % (PROFILER_RING_SIZE - PROFILER_KEPT_SIZE);
+    return thread->events[slot];
+}
+
+// NOTE(mevex): The events still held are [0, keptEnd) and [ringBegin, eventsCount)
+inline void GetProfileEventRanges(ProfilerThread *thread, u64 &keptEnd, u64 &ringBegin)
+{
+    u64 count = thread->eventsCount;
+    keptEnd = Min(count, (u64)PROFILER_KEPT_SIZE);
+    ringBegin = keptEnd;
+    if(count - keptEnd > PROFILER_RING_SIZE - PROFILER_KEPT_SIZE)
+        ringBegin = count - (PROFILER_RING_SIZE - PROFILER_KEPT_SIZE);
+}
+
+struct Profiler
+{
+    // NOTE(mevex): Taken only when a thread records its first zone and when writing the trace
+    std::mutex mutex;
+    vector<ProfilerThread *> threads;
+};
+
+global_variable Profiler globalProfiler;
+global_variable thread_local ProfilerThread *localProfilerThread;
+
+inline ProfilerThread *GetProfilerThread()
+{
+    if(!localProfilerThread)
+    {
+        ProfilerThread *thread = new ProfilerThread;
+        thread->eventsCount = 0;
+        
+        std::lock_guard<std::mutex> lock(globalProfiler.mutex);
+        thread->id = (u32)globalProfiler.threads.size();
+        globalProfiler.threads.push_back(thread);
+        localProfilerThread = thread;
+    }
+    return localProfilerThread;
+}
+
+inline void RecordZone(const char *name, u64 begin, u64 end)
+{
+    ProfilerThread *thread = GetProfilerThread();
+    ProfileEvent &event = GetProfileEvent(thread, thread->eventsCount);
+    event.name = name;
+    event.begin = begin;
+    event.end = end;
+    ++thread->eventsCount;
+}
+
+struct TimedZone
+{
+    const char *name;
+    u64 begin;
+    
+    TimedZone(const char *n) : name(n)
+    {
+        begin = ProfilerTicks(std::chrono::steady_clock::now());
+    }
+    
+    ~TimedZone()
+    {
+        RecordZone(name, begin, ProfilerTicks(std::chrono::steady_clock::now()));
+    }
+};
+
+#define PROFILER_CONCAT_(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT_(a, b)
+#define TIMED_ZONE(name) TimedZone PROFILER_CONCAT(timedZone, __LINE__)(name)
+#define TIMED_FUNCTION() TIMED_ZONE(__FUNCTION__)
+
+// NOTE(mevex): Must be called while no other thread is recording, e.g. between frames
+bool WriteProfilerTrace(const char *filename)
+{
+    FILE *file = OpenFile(filename, "w");
+    if(!file)
+        return false;
+    
+    std::lock_guard<std::mutex> lock(globalProfiler.mutex);
+    
+    // NOTE(mevex): Times are written in microseconds from the first zone still held
+    u64 origin = (u64)-1;
+    for(ProfilerThread *thread : globalProfiler.threads)
+    {
+        u64 keptEnd;
+        u64 ringBegin;
+        GetProfileEventRanges(thread, keptEnd, ringBegin);
+        for(u64 i = 0; i < thread->eventsCount; ++i)
+        {
+            if(i == keptEnd)
+                i = ringBegin;
+            if(i >= thread->eventsCount)
+                break;
+            
+            u64 begin = GetProfileEvent(thread, i).begin;
+            if(origin > begin)
+                origin = begin;
+        }
+    }
+    
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    bool first = true;
+    for(ProfilerThread *thread : globalProfiler.threads)
+    {
+        fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": \"thread %u\"}}",
+                first ? "" : ",\n", thread->id, thread->id);
+        first = false;
+        
+        u64 keptEnd;
+        u64 ringBegin;
+        GetProfileEventRanges(thread, keptEnd, ringBegin);
+        for(u64 i = 0; i < thread->eventsCount; ++i)
+        {
+            if(i == keptEnd)
+                i = ringBegin;
+            if(i >= thread->eventsCount)
+                break;
+            
+            ProfileEvent &event = GetProfileEvent(thread, i);
+            fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}",
+                    event.name, thread->id, (f64)(event.begin - origin) / 1000.0, (f64)(event.end - event.begin) / 1000.0);
+        }
+    }
+    fprintf(file, "\n]}\n");
+    
+    return fclose(file) == 0;
+}
+
+#else
+
+#define TIMED_ZONE(name)
+#define TIMED_FUNCTION()
+
+inline void RecordZone(const char *name, u64 begin, u64 end) {}
+inline bool WriteProfilerTrace(const char *filename) { return false; }
+
+#endif
+
+#endif //PROFILER_H
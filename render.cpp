@@ -0,0 +1,725 @@
+// NOTE(mevex): The rendering pipeline, shared by the demo (main.cpp) and the benchmark (benchmark.cpp)
+
+#include <chrono>
+
+// NOTE(mevex): Faces with more than three vertices are triangulated as fans. pool parses the file,
+//              share one between the meshes instead of starting threads for each of them.
+bool LoadObj(Mesh *mesh, const char* filename, const char* basepath, WorkerPool &pool)
+{
+    TIMED_FUNCTION();
+    
+    // NOTE(mevex): The binary cache lives next to the obj and is rebuilt when the obj or its mtl change.
+    //              The sources are read only when their stats do not match the ones of the cache.
+    std::string cachePath = std::string(filename) + ".cache";
+    MeshCacheSource source;
+    bool haveSource = false;
+    MappedFile cache;
+    MeshCacheHeader *header = MapMeshCache(cache, cachePath.c_str());
+    if(header)
+    {
+        bool valid = ObjSourcesUnchanged(filename, basepath, header->source);
+        if(!valid)
+        {
+            haveSource = HashObjSources(filename, basepath, source);
+            valid = haveSource && source.hash == header->source.hash && source.obj.size == header->source.obj.size;
+            if(valid && !UpdateMeshCacheSource(cachePath.c_str(), source))
+                printf("WARN: Could not update the mesh cache %s\n", cachePath.c_str());
+        }
+        
+        if(valid)
+        {
+            LoadMeshCache(mesh, cache);
+            printf("Loaded %s from %s\n", filename, cachePath.c_str());
+            return true;
+        }
+        UnmapFile(cache);
+    }
+    
+    if(!haveSource)
+        haveSource = HashObjSources(filename, basepath, source);
+    
+    printf("Loading %s\n", filename);
+    
+    std::string warn;
+    std::string err;
+    bool ret = ParseObj(mesh, filename, basepath, pool, warn, err);
+    
+    if (!warn.empty()) {
+        printf("WARN: %s\n", warn.c_str());
+    }
+    if (!err.empty()) {
+        printf("ERR: %s\n", err.c_str());
+    }
+    if (!ret) {
+        printf("Failed to load/parse .obj.\n");
+        return false;
+    }
+    
+    mesh->CalculateBoundingSphere();
+    mesh->CalculateFaceNormals();
+    mesh->OrderTrianglesForOverdraw();
+    
+    if(haveSource && !WriteMeshCache(mesh, cachePath.c_str(), source))
+        printf("WARN: Could not write the mesh cache %s\n", cachePath.c_str());
+    
+    return true;
+}
+
+int ClipSphere(Sphere s, Plane clippingPlane)
+{
+    f32 distance = Dot(s.center, clippingPlane.normal) + clippingPlane.d;
+    
+    if(Abs(distance) < s.r)
+        return UNKNOWN;
+    else if(distance < -s.r)
+        return DISCARDED;
+    return ACCEPTED;
+}
+
+struct ClipVertex
+{
+    p3 p;
+    v3 n;
+    // NOTE(mevex): Index in the vertex streams, -1 for the vertices created by the clipping
+    int index;
+};
+
+// NOTE(mevex): A vertex normal is the plain sum of the unit normals around it, so its length grows
+//              with the triangles it has. It is made unit length again before being interpolated,
+//              or the end shared by more triangles would pull the new normal towards it.
+inline ClipVertex GetClipVertex(VertexStreams &vertices, VertexStreams &vertexNormals, int index)
+{
+    v3 n = vertexNormals.Get(index);
+    f32 lengthSquared = Max(n.LengthSquared(), 1e-30f);
+    ClipVertex result = {vertices.Get(index), n / sqrtf(lengthSquared), index};
+    return result;
+}
+
+#define MAX_CLIP_POLYGON (3 + CLIPPING_PLANES_COUNT)
+
+// NOTE(mevex): A triangle in front of the near plane is clipped only against the side planes
+//              it pushes past the guard band. One crossing the near plane is clipped against
+//              everything it crosses, the guard band test means nothing for vertices behind the camera.
+inline u8 PlanesToClip(Triangle &tri, u8 *outcodes, u8 *guardcodes)
+{
+    u8 crossing = outcodes[tri.a] | outcodes[tri.b] | outcodes[tri.c];
+    if(crossing & (1 << NEAR))
+        return crossing;
+    return guardcodes[tri.a] | guardcodes[tri.b] | guardcodes[tri.c];
+}
+
+// NOTE(mevex): Clips every triangle against all the planes in planesMask in a single pass.
+//              Each triangle that crosses a plane becomes a small polygon on the stack that is
+//              clipped Sutherland-Hodgman style, plane after plane, and then fanned back into
+//              triangles. Only the vertices that survive every plane are added to the streams.
+//              A new vertex takes the normal interpolated between the two ends of the clipped edge,
+//              with the same t as its position, so the Gouraud shading does not change along the cut.
+//              Triangles that cross only side planes and stay inside the guard band are kept whole,
+//              see RenderSettings::guardBand.
+FixedArray<Triangle> ClipTriangles(FixedArray<Triangle> &tris, VertexStreams &vertices, VertexStreams &vertexNormals, u32 planesMask, Camera &cam, f32 guardBand, MemoryArena &arena, ThreadCounters *counters)
+{
+    size_t trisCount = tris.count;
+    
+    // NOTE(mevex): Outcodes are computed once per vertex, bit i is set when the vertex is outside plane i.
+    //              guardcodes have the same bits for the side planes pushed out to the guard band.
+    size_t verticesCount = vertices.count;
+    u8 *outcodes = arena.PushArray<u8>(verticesCount);
+    u8 *guardcodes = arena.PushArray<u8>(verticesCount);
+    for(int i = 0; i < verticesCount; ++i)
+    {
+        p3 v = vertices.Get(i);
+        u8 code = 0;
+        u8 guardcode = 0;
+        for(int plane = 0; plane < CLIPPING_PLANES_COUNT; ++plane)
+        {
+            if(!(planesMask & (1 << plane)))
+                continue;
+            
+            if(cam.ClipDistance(v, plane) < 0)
+                code |= (u8)(1 << plane);
+            if(cam.ClipDistance(v, plane, guardBand) < 0)
+                guardcode |= (u8)(1 << plane);
+        }
+        outcodes[i] = code;
+        guardcodes[i] = guardcode;
+    }
+    
+    // NOTE(mevex): Count the triangles that need clipping to bound the output
+    size_t keptCount = 0;
+    size_t crossingCount = 0;
+    for(int i = 0; i < trisCount; ++i)
+    {
+        Triangle tri = tris[i];
+        u8 codeA = outcodes[tri.a];
+        u8 codeB = outcodes[tri.b];
+        u8 codeC = outcodes[tri.c];
+        
+        if(codeA & codeB & codeC)
+            continue;
+        if(PlanesToClip(tri, outcodes, guardcodes))
+            ++crossingCount;
+        else
+            ++keptCount;
+    }
+    
+    size_t maxNewVerts = crossingCount * MAX_CLIP_POLYGON;
+    size_t maxNewTris = keptCount + crossingCount * (MAX_CLIP_POLYGON - 2);
+    
+    // NOTE(mevex): The new vertices are appended in place, the streams are moved only if they are full
+    VertexStreams *streams[2] = {&vertices, &vertexNormals};
+    for(VertexStreams *s : streams)
+    {
+        if(s->count + maxNewVerts > s->capacity)
+        {
+            VertexStreams grown = PushVertexStreams(arena, s->count + maxNewVerts);
+            memcpy(grown.x, s->x, s->count*sizeof(f32));
+            memcpy(grown.y, s->y, s->count*sizeof(f32));
+            memcpy(grown.z, s->z, s->count*sizeof(f32));
+            grown.count = s->count;
+            *s = grown;
+        }
+    }
+    
+    FixedArray<Triangle> resultingTris = arena.PushFixedArray<Triangle>(maxNewTris);
+    
+    for(int i = 0; i < trisCount; ++i)
+    {
+        Triangle tri = tris[i];
+        u8 codeA = outcodes[tri.a];
+        u8 codeB = outcodes[tri.b];
+        u8 codeC = outcodes[tri.c];
+        
+        if(codeA & codeB & codeC)
+        {
+            CountStat(counters, COUNTER_TRIANGLES_CLIP_DISCARDED, 1);
+            continue;
+        }
+        
+        u8 crossing = PlanesToClip(tri, outcodes, guardcodes);
+        if(!crossing)
+        {
+            resultingTris.Add(tri);
+            continue;
+        }
+        
+        ClipVertex buffers[2][MAX_CLIP_POLYGON];
+        ClipVertex *polygon = buffers[0];
+        ClipVertex *clipped = buffers[1];
+        polygon[0] = GetClipVertex(vertices, vertexNormals, tri.a);
+        polygon[1] = GetClipVertex(vertices, vertexNormals, tri.b);
+        polygon[2] = GetClipVertex(vertices, vertexNormals, tri.c);
+        int count = 3;
+        
+        for(int plane = 0; plane < CLIPPING_PLANES_COUNT && count >= 3; ++plane)
+        {
+            if(!(crossing & (1 << plane)))
+                continue;
+            
+            int clippedCount = 0;
+            ClipVertex previous = polygon[count - 1];
+            f32 dPrevious = cam.ClipDistance(previous.p, plane);
+            for(int v = 0; v < count; ++v)
+            {
+                ClipVertex current = polygon[v];
+                f32 dCurrent = cam.ClipDistance(current.p, plane);
+                
+                if((dCurrent >= 0) != (dPrevious >= 0))
+                {
+                    f32 t = dPrevious / (dPrevious - dCurrent);
+                    ClipVertex intersection = {Lerp(previous.p, current.p, t), Lerp(previous.n, current.n, t), -1};
+                    clipped[clippedCount++] = intersection;
+                }
+                if(dCurrent >= 0)
+                    clipped[clippedCount++] = current;
+                
+                previous = current;
+                dPrevious = dCurrent;
+            }
+            
+            Swap(polygon, clipped);
+            count = clippedCount;
+        }
+        
+        if(count < 3)
+        {
+            CountStat(counters, COUNTER_TRIANGLES_CLIP_DISCARDED, 1);
+            continue;
+        }
+        
+        CountStat(counters, COUNTER_TRIANGLES_CLIPPED, 1);
+        for(int v = 0; v < count; ++v)
+        {
+            if(polygon[v].index < 0)
+            {
+                polygon[v].index = (int)vertices.Add(polygon[v].p);
+                vertexNormals.Add(polygon[v].n);
+            }
+        }
+        
+        for(int v = 1; v + 1 < count; ++v)
+        {
+            Triangle t = {polygon[0].index, polygon[v].index, polygon[v + 1].index, tri.color};
+            resultingTris.Add(t);
+        }
+    }
+    
+    return resultingTris;
+}
+
+// NOTE(mevex): Backface culling done in object space with the normals of the mesh, before any
+//              vertex is transformed. Only the normals of the surviving triangles are moved to
+//              camera space, and added to normals.
+FixedArray<Triangle> CullBackFace(FixedArray<Triangle> &tris, FixedArray<v3> &faceNormals, VertexStreams &vertices, ObjectSpaceView &view, FixedArray<v3> &normals, MemoryArena &arena, ThreadCounters *counters)
+{
+    size_t trisCount = tris.count;
+    FixedArray<Triangle> resultingTris = arena.PushFixedArray<Triangle>(trisCount);
+    normals = arena.PushFixedArray<v3>(trisCount);
+    
+    // NOTE(mevex): A transform that mirrors the mesh flips the winding too
+    f32 facing = (view.determinant < 0) ? -1.0f : 1.0f;
+    
+    for(int i = 0; i < trisCount; ++i)
+    {
+        v3 n = faceNormals[i];
+        v3 toVertex = vertices.Get(tris[i].a) - view.eye;
+        
+        if(facing * Dot(n, toVertex) < 0)
+        {
+            resultingTris.Add(tris[i]);
+            normals.Add(CameraSpaceNormal(view, n));
+        }
+    }
+    
+    CountStat(counters, COUNTER_TRIANGLES_BACKFACE_CULLED, trisCount - resultingTris.count);
+    return resultingTris;
+}
+
+#define VERTEX_NOT_CACHED 0xFFFFFFFF
+
+// NOTE(mevex): Post-transform vertex cache. Every vertex referenced by the triangles is copied
+//              once into a compact stream, in order of first use, and the triangles are remapped to it.
+//              The vertices that no triangle uses are never transformed, projected or lit.
+//              extraCapacity leaves room for the vertices added by the clipping.
+VertexStreams GatherVertices(FixedArray<Triangle> &tris, VertexStreams &vertices, size_t extraCapacity, MemoryArena &arena)
+{
+    u32 *cacheSlots = arena.PushArray<u32>(vertices.count);
+    memset(cacheSlots, 0xFF, vertices.count*sizeof(u32));
+    
+    size_t capacity = Min(vertices.count, 3*tris.count);
+    VertexStreams result = PushVertexStreams(arena, capacity + extraCapacity);
+    for(Triangle &tri : tris)
+    {
+        int *corners[3] = {&tri.a, &tri.b, &tri.c};
+        for(int *corner : corners)
+        {
+            u32 &slot = cacheSlots[*corner];
+            if(slot == VERTEX_NOT_CACHED)
+                slot = (u32)result.Add(vertices.Get(*corner));
+            *corner = (int)slot;
+        }
+    }
+    
+    return result;
+}
+
+// NOTE(mevex): Gouraud shading. The normal of a vertex is the unweighted sum of the unit normals of
+//              the triangles around it, the lighting does not need it unit length. It is computed before
+//              the clipping, that interpolates it for the vertices it adds, so the streams get the
+//              same capacity as the vertices.
+VertexStreams ComputeVertexNormals(FixedArray<Triangle> &tris, FixedArray<v3> &normals, VertexStreams &vertices, MemoryArena &arena)
+{
+    size_t verticesCount = vertices.count;
+    VertexStreams vertexNormals = PushVertexStreams(arena, vertices.capacity);
+    vertexNormals.count = verticesCount;
+    memset(vertexNormals.x, 0, verticesCount*sizeof(f32));
+    memset(vertexNormals.y, 0, verticesCount*sizeof(f32));
+    memset(vertexNormals.z, 0, verticesCount*sizeof(f32));
+    for(int i = 0; i < tris.count; ++i)
+    {
+        Triangle &tri = tris[i];
+        v3 n = normals[i];
+        int corners[3] = {tri.a, tri.b, tri.c};
+        for(int v : corners)
+        {
+            vertexNormals.x[v] += n.x;
+            vertexNormals.y[v] += n.y;
+            vertexNormals.z[v] += n.z;
+        }
+    }
+    
+    return vertexNormals;
+}
+
+// NOTE(mevex): The lights are evaluated once per vertex instead of once per triangle corner
+f32 *ComputeVertexIntensities(VertexStreams &vertices, VertexStreams &vertexNormals, LightSet &lights, MemoryArena &arena)
+{
+    f32 *intensities = arena.PushArray<f32>(vertices.count);
+    ComputeLightIntensities(lights, vertices, vertexNormals, intensities);
+    
+    return intensities;
+}
+
+// NOTE(mevex): Charges the time since the previous lap to a stage. It does nothing unless
+//              RenderSettings::timeStages or RenderSettings::profileStages is set, reading the clock
+//              is not free. With profileStages and the profiler every lap is also a zone named after
+//              its stage.
+struct StageClock
+{
+    bool timeStages;
+    bool zones;
+    bool enabled;
+    RenderStats &stats;
+    std::chrono::steady_clock::time_point last;
+    
+    StageClock(bool t, bool z, RenderStats &s) : timeStages(t), zones(z && PROFILER), stats(s)
+    {
+        enabled = timeStages || zones;
+        if(enabled)
+            last = std::chrono::steady_clock::now();
+    }
+    
+    inline void Lap(int stage)
+    {
+        if(!enabled)
+            return;
+        
+        auto now = std::chrono::steady_clock::now();
+        if(timeStages)
+            stats.stageSeconds[stage] += std::chrono::duration<f64>(now - last).count();
+        if(zones)
+            RecordZone(stageNames[stage], ProfilerTicks(last), ProfilerTicks(now));
+        last = now;
+    }
+};
+
+// NOTE(mevex): Bounding spheres of the visible instances in camera space, in the same order
+Sphere *CameraSpaceSpheres(vector<Instance> &instances, FixedArray<VisibleInstance> &visibleInstances, Camera &cam, MemoryArena &arena)
+{
+    Sphere *result = arena.PushArray<Sphere>(visibleInstances.count);
+    for(size_t i = 0; i < visibleInstances.count; ++i)
+    {
+        Instance &inst = instances[visibleInstances[i].index];
+        m4x4 instTransform = inst.Transform();
+        m4x4 absoluteTransform = cam.transform * instTransform;
+        
+        Sphere s = inst.mesh->boundingSphere;
+        s.center = NotHomogeneous(absoluteTransform * HomogeneousPoint(s.center));
+        s.r *= inst.scale;
+        result[i] = s;
+    }
+    return result;
+}
+
+struct InstanceDepth
+{
+    f32 depth;
+    u32 slot;
+};
+
+// NOTE(mevex): Nearest first, by the nearest point of the bounding sphere so that the big instances
+//              around the camera go before the small ones next to them. Ties keep the list order.
+void SortFrontToBack(FixedArray<VisibleInstance> &visibleInstances, Sphere *&spheres, MemoryArena &arena)
+{
+    size_t count = visibleInstances.count;
+    InstanceDepth *depths = arena.PushArray<InstanceDepth>(count);
+    for(size_t i = 0; i < count; ++i)
+        depths[i] = {-spheres[i].center.z - spheres[i].r, (u32)i};
+    
+    std::sort(depths, depths + count, [](InstanceDepth &a, InstanceDepth &b)
+              {
+                  return a.depth < b.depth || (a.depth == b.depth && a.slot < b.slot);
+              });
+    
+    FixedArray<VisibleInstance> sorted = arena.PushFixedArray<VisibleInstance>(count);
+    Sphere *sortedSpheres = arena.PushArray<Sphere>(count);
+    for(size_t i = 0; i < count; ++i)
+    {
+        sortedSpheres[i] = spheres[depths[i].slot];
+        sorted.Add(visibleInstances[depths[i].slot]);
+    }
+    visibleInstances = sorted;
+    spheres = sortedSpheres;
+}
+
+// NOTE(mevex): Moves the instances whose bounding sphere is at least minRadius pixels on screen to
+//              the front of the list, keeping the order of both groups. Returns how many they are.
+size_t PartitionOccluders(FixedArray<VisibleInstance> &visibleInstances, Sphere *&spheres, f32 pixelsPerUnit, f32 minRadius, MemoryArena &arena)
+{
+    size_t count = visibleInstances.count;
+    FixedArray<VisibleInstance> result = arena.PushFixedArray<VisibleInstance>(count);
+    Sphere *resultSpheres = arena.PushArray<Sphere>(count);
+    bool *isOccluder = arena.PushArray<bool>(count);
+    size_t occludersCount = 0;
+    
+    // NOTE(mevex): Radius on screen >= minRadius, without dividing by the depth
+    //              that is 0 or negative when the camera is inside the sphere
+    for(size_t i = 0; i < count; ++i)
+        isOccluder[i] = spheres[i].r * pixelsPerUnit >= minRadius * -spheres[i].center.z;
+    
+    for(int pass = 0; pass < 2; ++pass)
+    {
+        for(size_t i = 0; i < count; ++i)
+        {
+            if(isOccluder[i] != (pass == 0))
+                continue;
+            
+            resultSpheres[result.count] = spheres[i];
+            result.Add(visibleInstances[i]);
+        }
+        if(pass == 0)
+            occludersCount = result.count;
+    }
+    
+    visibleInstances = result;
+    spheres = resultSpheres;
+    return occludersCount;
+}
+
+// NOTE(mevex): All the transient buffers of a frame come from frameArena, which is reset at the beginning
+RenderStats Render(vector<Instance> &instances, LightSet &lights, Canvas &canv, Camera &cam, RenderSettings &settings, MemoryArena &frameArena)
+{
+    TIMED_FUNCTION();
+    
+    RenderStats stats = {};
+    StageClock clock(settings.timeStages, settings.profileStages, stats);
+    
+    // NOTE(mevex): The geometry runs on this thread, so it counts as worker 0
+    ThreadCounters *counters = NULL;
+    if(settings.stats)
+    {
+        settings.stats->Begin();
+        counters = settings.stats->Thread(0);
+    }
+    
+    frameArena.Reset();
+    canv.Clear(Color(0.2f,0.5f,0.7f));
+    clock.Lap(STAGE_RASTER);
+    
+    if(settings.tiles)
+        settings.tiles->Begin(canv, settings.stats, settings.visibility, settings.rasterizer == RASTERIZER_FIXED_POINT);
+    if(settings.visibility)
+        settings.visibility->Begin(canv);
+    
+    // NOTE(mevex): Frustum culling of the instances, the BVH rejects whole groups of them at once
+    FixedArray<VisibleInstance> visibleInstances = frameArena.PushFixedArray<VisibleInstance>(instances.size());
+    if(settings.bvh)
+    {
+        // NOTE(mevex): The instance list changed since the BVH was built
+        if(settings.bvh->instanceBounds.size() != instances.size())
+            settings.bvh->Build(instances);
+        
+        Plane worldPlanes[CLIPPING_PLANES_COUNT];
+        WorldClippingPlanes(cam, worldPlanes);
+        settings.bvh->CullFrustum(worldPlanes, CLIPPING_PLANES_COUNT, visibleInstances);
+    }
+    else
+    {
+        for(u32 i = 0; i < (u32)instances.size(); ++i)
+            visibleInstances.Add({i, false});
+    }
+    CountStat(counters, COUNTER_INSTANCES_CULLED, instances.size() - visibleInstances.count);
+    clock.Lap(STAGE_CULL);
+    
+    // NOTE(mevex): The camera space spheres follow the instances through the sort and the partition
+    size_t occludersCount = 0;
+    Sphere *spheres = NULL;
+    if(settings.occlusion || settings.sortInstances)
+        spheres = CameraSpaceSpheres(instances, visibleInstances, cam, frameArena);
+    if(settings.sortInstances)
+    {
+        SortFrontToBack(visibleInstances, spheres, frameArena);
+        clock.Lap(STAGE_SORT);
+    }
+    if(settings.occlusion)
+    {
+        occludersCount = PartitionOccluders(visibleInstances, spheres, canv.height / cam.vpHeight, settings.occluderRadius, frameArena);
+        clock.Lap(STAGE_CULL);
+    }
+    
+    for(size_t v = 0; v < visibleInstances.count; ++v)
+    {
+        VisibleInstance visible = visibleInstances[v];
+        if(occludersCount && v >= occludersCount)
+        {
+            // NOTE(mevex): The pyramid needs the depth of the occluders, the tile renderer has
+            //              only binned them so far
+            if(v == occludersCount)
+            {
+                if(settings.tiles)
+                    settings.tiles->Flush(false);
+                clock.Lap(STAGE_RASTER);
+                settings.occlusion->Build(canv);
+            }
+            
+            if(settings.occlusion->Occluded(spheres[v], cam))
+            {
+                CountStat(counters, COUNTER_INSTANCES_OCCLUDED, 1);
+                clock.Lap(STAGE_CULL);
+                continue;
+            }
+        }
+        
+        Instance &inst = instances[visible.index];
+        m4x4 instTransform = inst.Transform();
+        m4x4 absoluteTransform = cam.transform * instTransform;
+        
+        // NOTE(mevex): Clipping
+        u32 unknownPlanes = 0;
+        if(!visible.insideFrustum)
+        {
+            Sphere testSphere = inst.mesh->boundingSphere;
+            testSphere.center = NotHomogeneous(absoluteTransform * HomogeneousPoint(testSphere.center));
+            testSphere.r *= inst.scale;
+            
+            int clipping = ACCEPTED;
+            for(int p = 0; p < CLIPPING_PLANES_COUNT; ++p)
+            {
+                int result = ClipSphere(testSphere, cam.clippingPlanes[p]);
+                
+                if(result == DISCARDED)
+                {
+                    clipping = DISCARDED;
+                    break;
+                }
+                else if(result == UNKNOWN)
+                {
+                    clipping = UNKNOWN;
+                    unknownPlanes |= 1 << p;
+                }
+            }
+            if(clipping == DISCARDED)
+            {
+                CountStat(counters, COUNTER_INSTANCES_CULLED, 1);
+                clock.Lap(STAGE_CULL);
+                continue;
+            }
+        }
+        
+        // NOTE(mevex): Cull in object space, then transform only the vertices that the surviving
+        //              triangles use, leaving room for the vertices that the clipping can add
+        VertexStreams meshVertices = inst.mesh->Streams();
+        FixedArray<Triangle> meshTriangles = inst.mesh->Triangles();
+        FixedArray<v3> meshNormals = inst.mesh->FaceNormals();
+        ObjectSpaceView view = GetObjectSpaceView(absoluteTransform);
+        
+        FixedArray<v3> normals;
+        FixedArray<Triangle> newTriangles = CullBackFace(meshTriangles, meshNormals, meshVertices, view, normals, frameArena, counters);
+        clock.Lap(STAGE_CULL);
+        
+        size_t clipCapacity = 0;
+        if(unknownPlanes)
+            clipCapacity = 2*newTriangles.count;
+        VertexStreams transformedVertices = GatherVertices(newTriangles, meshVertices, clipCapacity, frameArena);
+        TransformVertices(absoluteTransform, transformedVertices, transformedVertices);
+        clock.Lap(STAGE_TRANSFORM);
+        VertexStreams vertexNormals = ComputeVertexNormals(newTriangles, normals, transformedVertices, frameArena);
+        clock.Lap(STAGE_LIGHT);
+        
+        if(unknownPlanes)
+        {
+            newTriangles = ClipTriangles(newTriangles, transformedVertices, vertexNormals, unknownPlanes, cam, settings.guardBand, frameArena, counters);
+            clock.Lap(STAGE_CLIP);
+        }
+        
+        // NOTE(mevex): Project and light each vertex, including the ones added by the clipping
+        VertexStreams projectedVertices = PushVertexStreams(frameArena, transformedVertices.count);
+        ProjectVertices(cam, transformedVertices, projectedVertices);
+        clock.Lap(STAGE_PROJECT);
+        f32 *intensities = ComputeVertexIntensities(transformedVertices, vertexNormals, lights, frameArena);
+        clock.Lap(STAGE_LIGHT);
+        
+        stats.meshVerticesCount += meshVertices.count;
+        stats.processedVerticesCount += transformedVertices.count;
+        stats.rasterizedTrianglesCount += newTriangles.count;
+        CountStat(counters, COUNTER_INSTANCES_DRAWN, 1);
+        CountStat(counters, COUNTER_TRIANGLES_EMITTED, newTriangles.count);
+        
+        // NOTE(mevex): Draw each triangle. Without the tile renderer the visibility buffer keeps
+        //              the triangles itself, their ids are their indices there.
+        u32 *ids = settings.visibility ? settings.visibility->ids : NULL;
+        for(auto t : newTriangles)
+        {
+            f32 intensityA = intensities[t.a];
+            f32 intensityB = intensities[t.b];
+            f32 intensityC = intensities[t.c];
+            
+            ScreenTriangle screenTri = {projectedVertices.Get(t.a), projectedVertices.Get(t.b), projectedVertices.Get(t.c), intensityA, intensityB, intensityC, t.color};
+            if(settings.tiles)
+            {
+                settings.tiles->Add(screenTri);
+                continue;
+            }
+            
+            u32 id = ids ? settings.visibility->Add(screenTri) : 0;
+            if(settings.rasterizer == RASTERIZER_EDGE_FUNCTION)
+                stats.pixelsWrittenCount += DrawFilledTriangleEdge(screenTri.p0, screenTri.p1, screenTri.p2, intensityA, intensityB, intensityC, t.color, canv, counters, ids, id);
+            else if(settings.rasterizer == RASTERIZER_FIXED_POINT)
+                stats.pixelsWrittenCount += DrawFilledTriangleFixed(screenTri.p0, screenTri.p1, screenTri.p2, intensityA, intensityB, intensityC, t.color, canv, counters, ids, id);
+            else
+                stats.pixelsWrittenCount += DrawFilledTriangle(screenTri.p0, screenTri.p1, screenTri.p2, intensityA, intensityB, intensityC, t.color, canv, counters, ids, id);
+        }
+        clock.Lap(STAGE_RASTER);
+    }
+    
+    // NOTE(mevex): The tile renderer shades and resolves tile by tile
+    if(settings.tiles)
+    {
+        settings.tiles->Flush();
+        stats.pixelsWrittenCount += settings.tiles->pixelsWritten;
+    }
+    else
+    {
+        if(settings.visibility)
+            settings.visibility->Shade(canv, settings.visibility->triangles.data(), settings.rasterizer, 0, 0, canv.width - 1, canv.height - 1, counters);
+        canv.Resolve();
+    }
+    clock.Lap(STAGE_RASTER);
+    
+    if(settings.stats)
+        settings.stats->Merge();
+    
+    return stats;
+}
+
+// NOTE(mevex): Renders framesCount frames of the animation, frame i at time i / fps, and hands them
+//              to the writer as filenamePattern (a printf pattern taking the frame number). The two
+//              canvases are drawn to in turn, so while the writer encodes frame N the pipeline is
+//              already drawing frame N+1. Returns the statistics summed over all the frames, while
+//              settings.stats is reset by every Render and holds the counters of the last frame only.
+//              The frames that could not be written are counted by writer.FailedCount().
+//              With a pattern that does not take the frame number a Y4M video gets all the frames.
+RenderStats RenderAnimation(Animation &animation, int framesCount, f32 fps, const char *filenamePattern,
+                            vector<Instance> &instances, LightSet &lights, Canvas &canvasA, Canvas &canvasB,
+                            RenderSettings &settings, MemoryArena &frameArena, ImageWriter &writer, ImageSettings &imageSettings)
+{
+    TIMED_FUNCTION();
+    
+    Canvas *canvases[2] = {&canvasA, &canvasB};
+    u64 tickets[2] = {0, 0};
+    RenderStats result = {};
+    
+    for(int frame = 0; frame < framesCount; ++frame)
+    {
+        int buffer = frame % 2;
+        Canvas &canvas = *canvases[buffer];
+        f32 time = (f32)frame / fps;
+        
+        animation.PoseInstances(time, instances);
+        if(settings.bvh && settings.bvh->instanceBounds.size() == instances.size())
+            settings.bvh->Refit(instances);
+        Camera cam = animation.CameraAt(time, canvas);
+        
+        // NOTE(mevex): The writer may still be reading the frame drawn into this canvas two frames ago
+        writer.Wait(tickets[buffer]);
+        RenderStats stats = Render(instances, lights, canvas, cam, settings, frameArena);
+        
+        char filename[256];
+        snprintf(filename, sizeof(filename), filenamePattern, frame);
+        tickets[buffer] = writer.Submit(canvas, filename, imageSettings);
+        
+        result.Add(stats);
+    }
+    
+    writer.WaitAll();
+    return result;
+}
@@ -0,0 +1,69 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// NOTE(mevex): Thin wrappers over the SIMD registers so that the wide loops are written once.
+//              With AVX2 enabled (-arch:AVX2 on MSVC, -mavx2 on gcc/clang) the lanes are 8 wide,
+//              otherwise we fall back to the 4 wide SSE registers that every x64 CPU has.
+
+#include <immintrin.h>
+
+#if defined(__AVX2__)
+
+#define LANE_WIDTH 8
+typedef __m256 lane_f32;
+typedef __m256i lane_u32;
+
+inline lane_f32 LaneSet1(f32 a) { return _mm256_set1_ps(a); }
+inline lane_f32 LaneLoad(f32 *p) { return _mm256_loadu_ps(p); }
+inline void LaneStore(f32 *p, lane_f32 a) { _mm256_storeu_ps(p, a); }
+inline lane_f32 LaneAdd(lane_f32 a, lane_f32 b) { return _mm256_add_ps(a, b); }
+inline lane_f32 LaneSub(lane_f32 a, lane_f32 b) { return _mm256_sub_ps(a, b); }
+inline lane_f32 LaneMul(lane_f32 a, lane_f32 b) { return _mm256_mul_ps(a, b); }
+inline lane_f32 LaneDiv(lane_f32 a, lane_f32 b) { return _mm256_div_ps(a, b); }
+inline lane_f32 LaneMin(lane_f32 a, lane_f32 b) { return _mm256_min_ps(a, b); }
+inline lane_f32 LaneMax(lane_f32 a, lane_f32 b) { return _mm256_max_ps(a, b); }
+inline lane_f32 LaneSqrt(lane_f32 a) { return _mm256_sqrt_ps(a); }
+inline lane_f32 LaneIndices() { return _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f); }
+
+// NOTE(mevex): The comparisons give a mask lane, all bits set where true
+inline lane_f32 LaneGreater(lane_f32 a, lane_f32 b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+inline lane_f32 LaneSelect(lane_f32 mask, lane_f32 a, lane_f32 b) { return _mm256_blendv_ps(b, a, mask); }
+inline int LaneMoveMask(lane_f32 mask) { return _mm256_movemask_ps(mask); }
+
+inline lane_u32 LaneSet1U32(u32 a) { return _mm256_set1_epi32((int)a); }
+inline void LaneStoreU32(u32 *p, lane_u32 a) { _mm256_storeu_si256((__m256i *)p, a); }
+inline lane_u32 LaneTruncate(lane_f32 a) { return _mm256_cvttps_epi32(a); }
+inline lane_u32 LaneOr(lane_u32 a, lane_u32 b) { return _mm256_or_si256(a, b); }
+inline lane_u32 LaneShiftLeft(lane_u32 a, int bits) { return _mm256_slli_epi32(a, bits); }
+
+#else
+
+#define LANE_WIDTH 4
+typedef __m128 lane_f32;
+typedef __m128i lane_u32;
+
+inline lane_f32 LaneSet1(f32 a) { return _mm_set1_ps(a); }
+inline lane_f32 LaneLoad(f32 *p) { return _mm_loadu_ps(p); }
+inline void LaneStore(f32 *p, lane_f32 a) { _mm_storeu_ps(p, a); }
+inline lane_f32 LaneAdd(lane_f32 a, lane_f32 b) { return _mm_add_ps(a, b); }
+inline lane_f32 LaneSub(lane_f32 a, lane_f32 b) { return _mm_sub_ps(a, b); }
+inline lane_f32 LaneMul(lane_f32 a, lane_f32 b) { return _mm_mul_ps(a, b); }
+inline lane_f32 LaneDiv(lane_f32 a, lane_f32 b) { return _mm_div_ps(a, b); }
+inline lane_f32 LaneMin(lane_f32 a, lane_f32 b) { return _mm_min_ps(a, b); }
+inline lane_f32 LaneMax(lane_f32 a, lane_f32 b) { return _mm_max_ps(a, b); }
+inline lane_f32 LaneSqrt(lane_f32 a) { return _mm_sqrt_ps(a); }
+inline lane_f32 LaneIndices() { return _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f); }
+
+inline lane_f32 LaneGreater(lane_f32 a, lane_f32 b) { return _mm_cmpgt_ps(a, b); }
+inline lane_f32 LaneSelect(lane_f32 mask, lane_f32 a, lane_f32 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+inline int LaneMoveMask(lane_f32 mask) { return _mm_movemask_ps(mask); }
+
+inline lane_u32 LaneSet1U32(u32 a) { return _mm_set1_epi32((int)a); }
+inline void LaneStoreU32(u32 *p, lane_u32 a) { _mm_storeu_si128((__m128i *)p, a); }
+inline lane_u32 LaneTruncate(lane_f32 a) { return _mm_cvttps_epi32(a); }
+inline lane_u32 LaneOr(lane_u32 a, lane_u32 b) { return _mm_or_si128(a, b); }
+inline lane_u32 LaneShiftLeft(lane_u32 a, int bits) { return _mm_slli_epi32(a, bits); }
+
+#endif
+
+#endif //SIMD_H
@@ -0,0 +1,196 @@
+#ifndef STATS_H
+#define STATS_H
+
+// NOTE(mevex): Pipeline statistics. Every thread counts into its own cache line sized block and the
+//              blocks are summed by Merge at the end of the frame, so counting needs no atomics.
+//              Counting happens only when RenderSettings::stats is set, and building with
+//              RENDER_STATS=0 removes it completely: CountStat expands to nothing.
+
+#ifndef RENDER_STATS
+#define RENDER_STATS 1
+#endif
+
+enum pipeline_counter
+{
+    COUNTER_INSTANCES_CULLED,
+    COUNTER_INSTANCES_OCCLUDED,
+    COUNTER_INSTANCES_DRAWN,
+    COUNTER_TRIANGLES_BACKFACE_CULLED,
+    COUNTER_TRIANGLES_CLIP_DISCARDED,
+    COUNTER_TRIANGLES_CLIPPED,
+    COUNTER_TRIANGLES_EMITTED,
+    COUNTER_PIXELS_TESTED,
+    COUNTER_PIXELS_DEPTH_REJECTED,
+    COUNTER_PIXELS_WRITTEN,
+    COUNTER_PIXELS_SHADED,
+    
+    COUNTERS_COUNT
+};
+
+global_variable const char *counterNames[COUNTERS_COUNT] =
+{
+    "instances_culled",
+    "instances_occluded",
+    "instances_drawn",
+    "triangles_backface_culled",
+    "triangles_clipped_away",
+    "triangles_clipped",
+    "triangles_emitted",
+    "pixels_tested",
+    "pixels_depth_rejected",
+    "pixels_written",
+    "pixels_shaded",
+};
+
+struct alignas(64) ThreadCounters
+{
+    u64 e[COUNTERS_COUNT];
+    
+    // NOTE(mevex): Writes per pixel, shared by all the threads. It needs no atomics either since
+    //              a pixel is only ever touched by the thread that owns its tile.
+    u32 *overdraw;
+};
+
+#if RENDER_STATS
+#define CountStat(counters, counter, n) do { if(counters) (counters)->e[counter] += (n); } while(0)
+#else
+#define CountStat(counters, counter, n) do {} while(0)
+#endif
+
+class PipelineStats
+{
+    public:
+    
+    vector<ThreadCounters> threads;
+    u64 totals[COUNTERS_COUNT];
+    
+    i32 width;
+    i32 height;
+    vector<u32> overdraw;
+    
+    // NOTE(mevex): threadsCount must cover every worker that rasterizes, the overdraw buffer
+    //              is allocated only when asked for since it is as big as the canvas
+    PipelineStats(int threadsCount, Canvas &canvas, bool trackOverdraw = false) : threads(threadsCount)
+    {
+        width = canvas.width;
+        height = canvas.height;
+        if(trackOverdraw)
+            overdraw.resize(width * height);
+        Begin();
+    }
+    
+    void Begin()
+    {
+        for(ThreadCounters &t : threads)
+        {
+            memset(t.e, 0, sizeof(t.e));
+            t.overdraw = overdraw.empty() ? NULL : overdraw.data();
+        }
+        memset(totals, 0, sizeof(totals));
+        std::fill(overdraw.begin(), overdraw.end(), 0);
+    }
+    
+    inline ThreadCounters *Thread(int index)
+    {
+        Assert(index < (int)threads.size());
+        return &threads[index];
+    }
+    
+    void Merge()
+    {
+        memset(totals, 0, sizeof(totals));
+        for(ThreadCounters &t : threads)
+        {
+            for(int c = 0; c < COUNTERS_COUNT; ++c)
+                totals[c] += t.e[c];
+        }
+    }
+    
+    // NOTE(mevex): Valid after Merge
+    inline u64 Get(int counter)
+    {
+        return totals[counter];
+    }
+    
+    // NOTE(mevex): Average writes of the pixels written at least once, and the worst pixel
+    void GetOverdraw(f32 &average, u32 &maximum)
+    {
+        u64 written = 0;
+        u64 covered = 0;
+        maximum = 0;
+        for(u32 count : overdraw)
+        {
+            written += count;
+            covered += (count > 0);
+            if(maximum < count)
+                maximum = count;
+        }
+        average = covered ? (f32)((f64)written / covered) : 0.0f;
+    }
+    
+    void Print()
+    {
+        for(int c = 0; c < COUNTERS_COUNT; ++c)
+            printf("%-28s %llu\n", counterNames[c], (unsigned long long)totals[c]);
+        
+        if(!overdraw.empty())
+        {
+            f32 average;
+            u32 maximum;
+            GetOverdraw(average, maximum);
+            printf("%-28s %.2f average, %u max\n", "overdraw", average, maximum);
+        }
+    }
+    
+    // NOTE(mevex): Black where nothing was drawn, then blue -> green -> yellow -> red as the
+    //              writes go up to the worst pixel of the frame
+    bool WriteOverdrawHeatmap(const char *filename)
+    {
+        if(overdraw.empty())
+            return false;
+        
+        f32 average;
+        u32 maximum;
+        GetOverdraw(average, maximum);
+        f32 scale = maximum > 1 ? 1.0f / (f32)(maximum - 1) : 0.0f;
+        
+        vector<u32> image(width * height);
+        for(i32 y = 0; y < height; ++y)
+        {
+            for(i32 x = 0; x < width; ++x)
+            {
+                u32 count = overdraw[y*width + x];
+                f32 r = 0, g = 0, b = 0;
+                if(count)
+                {
+                    f32 t = (f32)(count - 1) * scale;
+                    if(t < 1.0f/3.0f)
+                    {
+                        b = 1.0f - 3.0f*t;
+                        g = 3.0f*t;
+                    }
+                    else if(t < 2.0f/3.0f)
+                    {
+                        r = 3.0f*t - 1.0f;
+                        g = 1.0f;
+                    }
+                    else
+                    {
+                        r = 1.0f;
+                        g = 3.0f - 3.0f*t;
+                    }
+                }
+                
+                // NOTE(mevex): Same layout as Canvas::memory, AABBGGRR with the rows bottom up
+                u32 red = (u32)(255.99f * r);
+                u32 green = (u32)(255.99f * g);
+                u32 blue = (u32)(255.99f * b);
+                image[(height - y - 1)*width + x] = 255u<<24 | blue << 16 | green << 8 | red;
+            }
+        }
+        
+        return stbi_write_png(filename, width, height, 4, image.data(), 0) != 0;
+    }
+};
+
+#endif //STATS_H
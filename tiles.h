@@ -0,0 +1,186 @@
+#ifndef TILES_H
+#define TILES_H
+
+#include "workers.h"
+
+// NOTE(mevex): Range of tiles owned by a worker. Both the owner and the thieves
+//              claim tiles with an atomic increment, so no lock is needed.
+struct alignas(64) TileQueue
+{
+    std::atomic<int> next;
+    int end;
+    
+    // NOTE(mevex): Written by the owner only, once it has no tiles left to take
+    u64 pixelsWritten;
+};
+
+// NOTE(mevex): Splits the canvas into square tiles, bins the triangles by their bounding box
+//              and rasterizes the tiles in parallel. Every tile writes only to its own pixels of
+//              Canvas::memory and Canvas::zBuffer and keeps the submission order of its triangles,
+//              so the result is the same as drawing the triangles one after the other.
+class TileRenderer
+{
+    public:
+    
+    // NOTE(mevex): Target of the frame being drawn, see Begin. Every target must have the size of
+    //              the canvas the renderer was created with.
+    Canvas *canvas;
+    WorkerPool pool;
+    
+    i32 tileSize;
+    i32 tilesX;
+    i32 tilesY;
+    
+    vector<ScreenTriangle> triangles;
+    vector<vector<u32>> bins;
+    vector<TileQueue> queues;
+    
+    // NOTE(mevex): Counters and visibility buffer of the frame being drawn, see Begin
+    PipelineStats *stats = NULL;
+    VisibilityBuffer *visibility = NULL;
+    bool fixedPoint = false;
+    
+    // NOTE(mevex): Set by Flush, only the last flush of the frame shades and resolves the tiles
+    bool finishing = true;
+    
+    // NOTE(mevex): Pixels that passed the depth test since Begin, summed by every Flush
+    u64 pixelsWritten = 0;
+    
+    TileRenderer(Canvas &c, i32 size = 64, int threadsCount = (int)std::thread::hardware_concurrency()) :
+    canvas(&c), pool(threadsCount), queues(pool.workersCount)
+    {
+        // NOTE(mevex): With the tiled layout Resolve works on whole blocks, a tile ending inside a
+        //              block would resolve pixels that the thread of the next tile is drawing
+        Assert(size % CANVAS_BLOCK_SIZE == 0);
+        tileSize = size;
+        tilesX = (c.width + tileSize - 1) / tileSize;
+        tilesY = (c.height + tileSize - 1) / tileSize;
+        bins.resize(tilesX * tilesY);
+    }
+    
+    void Begin(Canvas &target, PipelineStats *frameStats = NULL, VisibilityBuffer *frameVisibility = NULL, bool frameFixedPoint = false)
+    {
+        Assert(target.width == canvas->width && target.height == canvas->height);
+        Assert(!frameStats || (int)frameStats->threads.size() >= pool.workersCount);
+        canvas = &target;
+        stats = frameStats;
+        visibility = frameVisibility;
+        fixedPoint = frameFixedPoint;
+        pixelsWritten = 0;
+        
+        // NOTE(mevex): clear() keeps the capacity, so after the first frame binning does not allocate
+        triangles.clear();
+        for(auto &bin : bins)
+            bin.clear();
+    }
+    
+    void Add(ScreenTriangle &t)
+    {
+        f32 minXf = Min(t.p0.x, Min(t.p1.x, t.p2.x));
+        f32 maxXf = Max(t.p0.x, Max(t.p1.x, t.p2.x));
+        f32 minYf = Min(t.p0.y, Min(t.p1.y, t.p2.y));
+        f32 maxYf = Max(t.p0.y, Max(t.p1.y, t.p2.y));
+        
+        // NOTE(mevex): A pixel wider than the bounds of DrawFilledTriangleEdge, the fixed point
+        //              rasterizer snaps the vertices and can reach the next pixel center
+        i32 minX = Max((i32)floor(minXf), 0);
+        i32 maxX = Min((i32)ceil(maxXf), canvas->width - 1);
+        i32 minY = Max((i32)floor(minYf), 0);
+        i32 maxY = Min((i32)ceil(maxYf), canvas->height - 1);
+        if(minX > maxX || minY > maxY)
+            return;
+        
+        u32 index = (u32)triangles.size();
+        triangles.push_back(t);
+        
+        for(i32 ty = minY / tileSize; ty <= maxY / tileSize; ++ty)
+        {
+            for(i32 tx = minX / tileSize; tx <= maxX / tileSize; ++tx)
+                bins[ty*tilesX + tx].push_back(index);
+        }
+    }
+    
+    u64 RasterizeTile(int tile, ThreadCounters *counters)
+    {
+        u64 written = 0;
+        vector<u32> &bin = bins[tile];
+        
+        i32 minX = (tile % tilesX) * tileSize;
+        i32 minY = (tile / tilesX) * tileSize;
+        i32 maxX = Min(minX + tileSize - 1, canvas->width - 1);
+        i32 maxY = Min(minY + tileSize - 1, canvas->height - 1);
+        
+        u32 *ids = visibility ? visibility->ids : NULL;
+        for(u32 index : bin)
+        {
+            ScreenTriangle &t = triangles[index];
+            if(fixedPoint)
+                written += DrawFilledTriangleFixed(t.p0, t.p1, t.p2, t.i0, t.i1, t.i2, t.color, *canvas, minX, minY, maxX, maxY, counters, ids, index);
+            else
+                written += DrawFilledTriangleEdge(t.p0, t.p1, t.p2, t.i0, t.i1, t.i2, t.color, *canvas, minX, minY, maxX, maxY, counters, ids, index);
+        }
+        
+        if(!finishing)
+            return written;
+        
+        // NOTE(mevex): With a float color buffer the tile is resolved while it is still in the cache,
+        //              the empty tiles too since they hold the clear color. The ids are the indices
+        //              of our triangles.
+        if(visibility)
+            visibility->Shade(*canvas, triangles.data(), fixedPoint ? RASTERIZER_FIXED_POINT : RASTERIZER_EDGE_FUNCTION, minX, minY, maxX, maxY, counters);
+        canvas->Resolve(minX, minY, maxX, maxY);
+        return written;
+    }
+    
+    shared_function void RasterizeTilesWork(void *data, int workerIndex)
+    {
+        TIMED_FUNCTION();
+        
+        TileRenderer *renderer = (TileRenderer *)data;
+        int workersCount = renderer->pool.workersCount;
+        ThreadCounters *counters = renderer->stats ? renderer->stats->Thread(workerIndex) : NULL;
+        
+        // NOTE(mevex): Drain our own queue first, then steal from the others
+        u64 written = 0;
+        for(int i = 0; i < workersCount; ++i)
+        {
+            TileQueue &queue = renderer->queues[(workerIndex + i) % workersCount];
+            while(true)
+            {
+                int tile = queue.next.fetch_add(1, std::memory_order_relaxed);
+                if(tile >= queue.end)
+                    break;
+                
+                written += renderer->RasterizeTile(tile, counters);
+            }
+        }
+        renderer->queues[workerIndex].pixelsWritten = written;
+    }
+    
+    // NOTE(mevex): A frame can be flushed more than once, when something needs its depth before
+    //              all the triangles are in (see RenderSettings::occlusion). Only the last flush,
+    //              with finish set, shades and resolves. The triangles stay until the next Begin
+    //              since the visibility buffer refers to them.
+    void Flush(bool finish = true)
+    {
+        TIMED_FUNCTION();
+        
+        finishing = finish;
+        int tilesCount = tilesX * tilesY;
+        int workersCount = pool.workersCount;
+        for(int i = 0; i < workersCount; ++i)
+        {
+            queues[i].next.store(i * tilesCount / workersCount, std::memory_order_relaxed);
+            queues[i].end = (i + 1) * tilesCount / workersCount;
+        }
+        
+        pool.Run(RasterizeTilesWork, this);
+        for(TileQueue &queue : queues)
+            pixelsWritten += queue.pixelsWritten;
+        
+        for(auto &bin : bins)
+            bin.clear();
+    }
+};
+
+#endif //TILES_H
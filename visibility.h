@@ -0,0 +1,127 @@
+#ifndef VISIBILITY_H
+#define VISIBILITY_H
+
+// NOTE(mevex): Visibility buffer. The rasterizers write only the depth and the id of the triangle
+//              that won the pixel, and Shade lights and packs every visible pixel once, so the cost
+//              of shading does not grow with the overdraw. The id is the index of the triangle in
+//              the list of the frame: triangles for the rasterizers that draw right away, the one
+//              of the tile renderer when it is used (it shades each tile before resolving it).
+//              Like the tile renderer it belongs to the settings and not to a canvas, Begin takes
+//              the target of the frame, which must have the size and the layout of the first one.
+
+#define VISIBILITY_EMPTY 0xFFFFFFFF
+
+class VisibilityBuffer
+{
+    public:
+    
+    i32 width;
+    i32 height;
+    int layoutType;
+    size_t pixelsCount;
+    
+    // NOTE(mevex): Same pixel order as the buffers of the canvas
+    u32 *ids;
+    vector<ScreenTriangle> triangles;
+    
+    VisibilityBuffer(Canvas &canvas)
+    {
+        width = canvas.width;
+        height = canvas.height;
+        layoutType = canvas.layout.type;
+        pixelsCount = canvas.pixelsCount;
+        ids = (u32 *)malloc(sizeof(u32) * pixelsCount);
+        std::fill(ids, ids + pixelsCount, VISIBILITY_EMPTY);
+    }
+    
+    ~VisibilityBuffer()
+    {
+        free(ids);
+    }
+    
+    VisibilityBuffer(const VisibilityBuffer &) = delete;
+    VisibilityBuffer &operator=(const VisibilityBuffer &) = delete;
+    
+    void Begin(Canvas &target)
+    {
+        Assert(target.width == width && target.height == height && target.layout.type == layoutType);
+        std::fill(ids, ids + pixelsCount, VISIBILITY_EMPTY);
+        triangles.clear();
+    }
+    
+    inline u32 Add(ScreenTriangle &t)
+    {
+        u32 id = (u32)triangles.size();
+        triangles.push_back(t);
+        return id;
+    }
+    
+    // NOTE(mevex): Shades the visible pixels of the inclusive rectangle, the ids index frameTriangles
+    //              and rasterizer is the one that wrote them. The intensity plane is set up again only
+    //              when the id changes. The edge function and fixed point rasterizers evaluate the very
+    //              same plane, so the result is the one of drawing right away, pixel for pixel.
+    //              The scanline rasterizer interpolates along the edges and then along the spans from
+    //              rounded vertices instead, next to the plane a pixel can be a few tens of levels off.
+    void Shade(Canvas &canvas, ScreenTriangle *frameTriangles, int rasterizer, i32 minX, i32 minY, i32 maxX, i32 maxY, ThreadCounters *counters = NULL)
+    {
+        u64 pixelsShaded = 0;
+        u32 currentId = VISIBILITY_EMPTY;
+        ScreenTriangle *t = NULL;
+        IntensityPlane plane = {};
+        bool scanline = (rasterizer == RASTERIZER_SCANLINE);
+        f32 minI = 0;
+        f32 maxI = 0;
+        
+        PixelLayout layout = canvas.layout;
+        for(i32 y = minY; y <= maxY; ++y)
+        {
+            size_t rowOffset = layout.Row(y);
+            for(i32 x = minX; x <= maxX; ++x)
+            {
+                size_t offset = rowOffset + layout.Column(x);
+                u32 id = ids[offset];
+                if(id == VISIBILITY_EMPTY)
+                    continue;
+                
+                if(id != currentId)
+                {
+                    currentId = id;
+                    t = frameTriangles + id;
+                    
+                    if(rasterizer == RASTERIZER_FIXED_POINT)
+                        FixedIntensityPlane(*t, plane);
+                    else if(!scanline)
+                        EdgeIntensityPlane(*t, plane);
+                    else
+                    {
+                        // NOTE(mevex): The scanline rasterizer draws the triangles with no area too,
+                        //              they get the intensity of their first vertex
+                        f32 area = EdgeFunction(t->p0.x, t->p0.y, t->p1.x, t->p1.y, t->p2.x, t->p2.y);
+                        f32 invArea = (Abs(area) < ZERO) ? 0.0f : 1.0f / area;
+                        plane.x0 = t->p0.x;
+                        plane.y0 = t->p0.y;
+                        plane.i0 = t->i0;
+                        plane.idx = ((t->p1.y - t->p2.y)*t->i0 + (t->p2.y - t->p0.y)*t->i1 + (t->p0.y - t->p1.y)*t->i2) * invArea;
+                        plane.idy = ((t->p2.x - t->p1.x)*t->i0 + (t->p0.x - t->p2.x)*t->i1 + (t->p1.x - t->p0.x)*t->i2) * invArea;
+                        
+                        // NOTE(mevex): It also covers pixels a bit outside of the triangle, where the
+                        //              plane of a sliver can go anywhere. Drawing right away never
+                        //              leaves the range of the vertices, so neither does this.
+                        minI = Min(t->i0, Min(t->i1, t->i2));
+                        maxI = Max(t->i0, Max(t->i1, t->i2));
+                    }
+                }
+                
+                f32 i = plane.At(plane.Row(y), x);
+                if(scanline)
+                    i = Min(Max(i, minI), maxI);
+                canvas.WritePixel(offset, t->color*i);
+                ++pixelsShaded;
+            }
+        }
+        
+        CountStat(counters, COUNTER_PIXELS_SHADED, pixelsShaded);
+    }
+};
+
+#endif //VISIBILITY_H
@@ -0,0 +1,102 @@
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+typedef void worker_callback(void *data, int workerIndex);
+
+// NOTE(mevex): Persistent threads that all run the same callback when Run is called.
+//              The thread calling Run takes part in the work as worker 0.
+class WorkerPool
+{
+    public:
+    
+    int workersCount;
+    vector<std::thread> threads;
+    
+    std::mutex mutex;
+    std::condition_variable startCondition;
+    std::condition_variable finishCondition;
+    worker_callback *callback;
+    void *callbackData;
+    u64 generation;
+    int running;
+    bool quit;
+    
+    WorkerPool(int count)
+    {
+        workersCount = count > 0 ? count : 1;
+        callback = NULL;
+        callbackData = NULL;
+        generation = 0;
+        running = 0;
+        quit = false;
+        
+        for(int i = 1; i < workersCount; ++i)
+            threads.push_back(std::thread(&WorkerPool::WorkerLoop, this, i));
+    }
+    
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        startCondition.notify_all();
+        
+        for(auto &t : threads)
+            t.join();
+    }
+    
+    void WorkerLoop(int workerIndex)
+    {
+        u64 seenGeneration = 0;
+        
+        while(true)
+        {
+            worker_callback *work;
+            void *data;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                startCondition.wait(lock, [&]{ return quit || generation != seenGeneration; });
+                if(quit)
+                    return;
+                
+                seenGeneration = generation;
+                work = callback;
+                data = callbackData;
+            }
+            
+            work(data, workerIndex);
+            
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                --running;
+                if(running == 0)
+                    finishCondition.notify_one();
+            }
+        }
+    }
+    
+    void Run(worker_callback *work, void *data)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            callback = work;
+            callbackData = data;
+            running = workersCount - 1;
+            ++generation;
+        }
+        startCondition.notify_all();
+        
+        work(data, 0);
+        
+        std::unique_lock<std::mutex> lock(mutex);
+        finishCondition.wait(lock, [&]{ return running == 0; });
+    }
+};
+
+#endif //WORKERS_H